@@ -0,0 +1,111 @@
+/**
+ * @file boundedQueue.hpp
+ * @brief Blocking queue of bounded capacity linking the stages of a pipeline
+ */
+#ifndef BOUNDED_QUEUE_HPP
+#define BOUNDED_QUEUE_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <utility>
+
+/**
+ * @class BoundedQueue
+ *
+ * @brief Thread-safe FIFO queue that blocks the producers while it is full.
+ *
+ * @tparam T Type of the queued items, at least movable.
+ *
+ * @details The capacity bounds the work in flight between two stages: a fast producer waits for the consumers
+ * instead of piling up items, so the backpressure travels up to the source. Closing the queue wakes every waiting
+ * thread, rejects new items and lets the consumers drain the remaining ones.
+ */
+template <typename T>
+class BoundedQueue
+{
+  public:
+    /**
+     * @brief Constructs a new BoundedQueue object.
+     *
+     * @param capacity Maximum number of queued items, at least 1.
+     */
+    explicit BoundedQueue(std::size_t capacity) : m_capacity(capacity > 0 ? capacity : 1), m_closed(false)
+    {
+    }
+
+    /**
+     * @brief Appends an item, waiting while the queue is full.
+     *
+     * @param item The item.
+     *
+     * @return False if the queue was closed, in which case the item is dropped.
+     */
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notFull.wait(lock, [this] { return m_closed || m_items.size() < m_capacity; });
+        if (m_closed)
+        {
+            return false;
+        }
+        m_items.push_back(std::move(item));
+        lock.unlock();
+        m_notEmpty.notify_one();
+        return true;
+    }
+
+    /**
+     * @brief Removes the oldest item, waiting while the queue is empty.
+     *
+     * @return The item, or nullopt once the queue is closed and drained.
+     */
+    std::optional<T> pop()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notEmpty.wait(lock, [this] { return m_closed || !m_items.empty(); });
+        if (m_items.empty())
+        {
+            return std::nullopt;
+        }
+        std::optional<T> item(std::move(m_items.front()));
+        m_items.pop_front();
+        lock.unlock();
+        m_notFull.notify_one();
+        return item;
+    }
+
+    /**
+     * @brief Closes the queue, waking every waiting producer and consumer.
+     */
+    void close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_closed = true;
+        }
+        m_notFull.notify_all();
+        m_notEmpty.notify_all();
+    }
+
+    /**
+     * @brief Gets the number of queued items.
+     */
+    std::size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_items.size();
+    }
+
+  private:
+    mutable std::mutex m_mutex;         /**< Protects the items and the closed flag. */
+    std::condition_variable m_notFull;  /**< Notified when an item is removed or the queue is closed. */
+    std::condition_variable m_notEmpty; /**< Notified when an item is added or the queue is closed. */
+    std::deque<T> m_items;              /**< Queued items, oldest first. */
+    std::size_t m_capacity;             /**< Maximum number of queued items. */
+    bool m_closed;                      /**< Whether the queue was closed. */
+};
+
+#endif
@@ -11,15 +11,22 @@
 #include <fstream>
 #include <iostream>
 
+#include "contentHash.hpp"
 #include "cppSocket.hpp"
+#include "edgeMapCodec.hpp"
 #include "httplib.h"
+#include "imageProtocol.hpp"
+#include <algorithm>
 
 #include <arpa/inet.h>
+#include <cerrno>
 #include <cstring>
 #include <fstream>
+#include <condition_variable>
 #include <iostream>
 #include <memory>
 #include <mutex>
+#include <nlohmann/json.hpp>
 #include <sstream>
 #include <sys/socket.h>
 #include <thread>
@@ -30,6 +37,11 @@
  */
 #define BUFSIZECLI 2048
 
+/**
+ * @brief Size of the buffers used to receive the images.
+ */
+#define RECVBUFSIZE (1024 * 1024)
+
 /**
  * @brief Maximum client length.
  */
@@ -60,16 +72,72 @@
  */
 #define SUCCESS 200
 
+/**
+ * @brief Accepted code.
+ */
+#define ACCEPTED 202
+
+/**
+ * @brief Not modified code.
+ */
+#define NOTMODIFIED 304
+
 /**
  * @brief Path of the received image.
  */
 #define RECIMAGE "../imgtrial/ReceiveImage_"
 
+/**
+ * @brief Path of the image downloaded over HTTP.
+ */
+#define HTTPIMAGE "../imgtrial/ReceiveImage_http.pgm"
+
+/**
+ * @brief Path of the edge segments downloaded over HTTP.
+ */
+#define HTTPSEGMENTS "../imgtrial/segments.json"
+
+/**
+ * @brief Prefix of the path of the job results.
+ */
+#define JOBIMAGE "../imgtrial/ReceiveImage_job_"
+
+/**
+ * @brief Size of the chunks of an uploaded image.
+ */
+#define UPLOADCHUNK (64 * 1024)
+
 /**
  * @brief Configuration file path.
  */
 #define CONFPATH "../startproject/configuration.txt"
 
+/**
+ * @brief Maximum time to wait for the image channel handshake, in seconds.
+ */
+#define HANDSHAKETIMEOUT 5
+
+/**
+ * @brief Longest wait asked to the server when following a job, in seconds.
+ */
+#define JOBWAIT 20
+
+/**
+ * @brief Progress of the image download, kept across reconnections of the image channel.
+ */
+struct ImageDownload
+{
+    std::mutex mutex;                       /**< Protects the download state. */
+    std::condition_variable channelChanged; /**< Notified when the image channel opens or closes. */
+    bool connected = false;                 /**< Whether the image channel is open and registered. */
+    std::uint64_t hash = 0;                 /**< Content hash of the image being or last downloaded, 0 if none. */
+    std::uint64_t totalSize = 0;            /**< Size of that image. */
+    std::uint64_t received = 0;             /**< Number of bytes of that image stored in the file. */
+    std::uint64_t runningHash = FNVOFFSET;  /**< Content hash of the bytes stored in the file. */
+    std::string fileName;                   /**< File holding that image. */
+    int imageCounter = 0;                   /**< Number of images started. */
+};
+
 /**
  * @brief Gets the username and password from the user.
  *
@@ -80,11 +148,28 @@
  * character arrays.
  */
 void GetCredentials(char* username, char* password);
+/**
+ * @brief Reads an exact number of bytes from a socket.
+ *
+ * @param socket The socket to read from.
+ * @param data The buffer to fill.
+ * @param size The number of bytes to read.
+ *
+ * @return False if the connection was closed or failed before all the bytes arrived.
+ */
+bool ReadExact(int socket, char* data, std::size_t size);
+
 /**
  * @brief Handles the TCPv6 client.
  *
  * @param client A unique pointer to a TCPv6Connection object representing the client.
  * @param token A string representing the token of the client.
+ *
+ * @details This function reads the Hello frame of the server, answers with the token and then receives image frames
+ * until the connection closes. Every image is written to a new file and checked against the content hash of its
+ * header. A frame continuing the image that was interrupted is appended to its file instead, the download state
+ * keeping how many bytes arrived and their hash across connections. The socket and user-space receive buffers are
+ * large, so big images arrive in few reads.
  */
 void HandleTCPv6Client(std::unique_ptr<TCPv6Connection> client, const std::string& token);
 
@@ -124,9 +209,89 @@ void GetAlerts(httplib::Client& cli);
  * @brief Sends a GET request to the server to retrieve an image.
  *
  * @param cli httplib::Client object used for HTTP communication.
+ *
+ * @details The ETag of the last image received is sent in If-None-Match, so the server answers 304 without a body
+ * when the image did not change. A new image is decoded and saved to HTTPIMAGE.
  */
 void GetImage(httplib::Client& cli);
 
+/**
+ * @brief Sends a GET request to the server to retrieve the edge segments of the image, without its pixels.
+ *
+ * @param cli httplib::Client object used for HTTP communication.
+ *
+ * @details The segments are saved as JSON to HTTPSEGMENTS.
+ */
+void GetSegments(httplib::Client& cli);
+
+/**
+ * @brief Sends a GET request to the server to retrieve the edge density per grid cell and entry zone of the image.
+ *
+ * @param cli httplib::Client object used for HTTP communication.
+ */
+void GetDensity(httplib::Client& cli);
+
+/**
+ * @brief Decodes an edge map and saves it as a binary PGM image.
+ *
+ * @param data The encoded edge map.
+ * @param size Size of the encoded edge map.
+ * @param fileName Path of the PGM image.
+ *
+ * @return True if the image was saved.
+ */
+bool SaveEdgeMapAsPgm(const char* data, std::size_t size, const std::string& fileName);
+
+/**
+ * @brief Sends an image command to the server, resuming or skipping the download when possible.
+ *
+ * @param cli httplib::Client object used for HTTP communication.
+ * @param params httplib::Params object used for HTTP communication.
+ * @param token The token to be sent to the server.
+ * @param hostname IP address of the server as a character string.
+ *
+ * @details This function reopens the image channel if it was closed and sends the content hash of the image being or
+ * last downloaded with the number of bytes already received, so the server only sends what is missing, or nothing if
+ * the image is the current one. If the image is still being processed, the job is followed until it ends and the
+ * command is sent again.
+ */
+void RequestImage(httplib::Client& cli, httplib::Params& params, const std::string& token, const char* hostname);
+
+/**
+ * @brief Uploads an image for edge detection.
+ *
+ * @param cli httplib::Client object used for HTTP communication.
+ * @param token The token to be sent to the server.
+ * @param command The "upload" command followed by the path of the image and optionally the priority of the job, then
+ * the low and high thresholds and the sigma of Canny.
+ *
+ * @details The file is streamed in UPLOADCHUNK pieces, without loading it whole, and the id of the job is printed.
+ */
+void UploadImage(httplib::Client& cli, const std::string& token, const std::string& command);
+
+/**
+ * @brief Fetches the result of an edge detection job.
+ *
+ * @param cli httplib::Client object used for HTTP communication.
+ * @param command The "result" command followed by the id of the job.
+ *
+ * @details A finished job is decoded and saved to JOBIMAGE followed by the id. A queued or running job is followed
+ * until it ends first.
+ */
+void GetJobResult(httplib::Client& cli, const std::string& command);
+
+/**
+ * @brief Follows a job until it ends, printing its progress.
+ *
+ * @param cli httplib::Client object used for HTTP communication.
+ * @param id The id of the job.
+ *
+ * @return True if the job is done, false if it failed or could not be followed.
+ *
+ * @details Each request long-polls the server until the progress of the job changes, for at most JOBWAIT seconds.
+ */
+bool WaitForJob(httplib::Client& cli, const std::string& id);
+
 /**
  * @brief Sends a POST request to the server to modify data or end the session.
  *
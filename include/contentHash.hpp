@@ -0,0 +1,40 @@
+/**
+ * @file contentHash.hpp
+ * @brief Content hash shared by the server and the client to identify image versions
+ */
+#ifndef CONTENT_HASH_HPP
+#define CONTENT_HASH_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief FNV-1a 64-bit offset basis.
+ */
+#define FNVOFFSET 14695981039346656037ULL
+
+/**
+ * @brief FNV-1a 64-bit prime.
+ */
+#define FNVPRIME 1099511628211ULL
+
+/**
+ * @brief Computes the FNV-1a 64-bit hash of a buffer.
+ *
+ * @param data Buffer to hash.
+ * @param size Size of the buffer.
+ * @param hash Hash of the preceding bytes, to hash a buffer received in pieces.
+ *
+ * @return The hash of the buffer.
+ */
+inline std::uint64_t ContentHash(const char* data, std::size_t size, std::uint64_t hash = FNVOFFSET)
+{
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= FNVPRIME;
+    }
+    return hash;
+}
+
+#endif
@@ -0,0 +1,64 @@
+/**
+ * @file edgeDensity.hpp
+ * @brief Edge density summaries of the published edge map, per grid cell and per entry zone
+ */
+#ifndef EDGE_DENSITY_HPP
+#define EDGE_DENSITY_HPP
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Default number of grid cells per side of the density summary.
+ */
+#define DENSITYGRID 8
+
+/**
+ * @brief Depth of the entry zones, as a share of the height (north, south) or width (west, east) of the image.
+ */
+#define DENSITYZONESHARE 0.25
+
+/**
+ * @brief Database key of the density summary of the published edge map.
+ */
+#define DENSITYKEY "density"
+
+/**
+ * @brief Share of edge pixels over the image, a grid and the entry zones.
+ */
+struct EdgeDensity
+{
+    std::uint64_t version;               /**< Version of the published image the summary comes from. */
+    std::uint32_t rows;                  /**< Height of the image in pixels. */
+    std::uint32_t cols;                  /**< Width of the image in pixels. */
+    int grid;                            /**< Number of cells per side. */
+    double total;                        /**< Share of edge pixels over the image. */
+    std::vector<double> cells;           /**< Share of edge pixels per cell, row major. */
+    std::map<std::string, double> zones; /**< Share of edge pixels per entry zone, named like the alerts. */
+
+    /**
+     * @brief Serializes the summary as JSON.
+     */
+    std::string toJson() const;
+};
+
+/**
+ * @brief Computes the edge density summary of an edge map.
+ *
+ * @param pixels Row major 8-bit pixels without padding, any non zero pixel is an edge.
+ * @param rows Height in pixels.
+ * @param cols Width in pixels.
+ * @param grid Number of cells per side, reduced for images smaller than the grid.
+ *
+ * @return The summary, with version 0.
+ *
+ * @details Every row is packed to one bit per pixel and the edges of any column range are counted with popcount over
+ * the packed words, rows in parallel. The entry zones are bands along the sides of the image, DENSITYZONESHARE deep,
+ * so the corners belong to two zones.
+ */
+EdgeDensity ComputeEdgeDensity(const std::uint8_t* pixels, std::uint32_t rows, std::uint32_t cols,
+                               int grid = DENSITYGRID);
+
+#endif
@@ -0,0 +1,108 @@
+/**
+ * @file edgeMapCodec.hpp
+ * @brief Compact encoding of binary edge maps, shared by the server and the client
+ */
+#ifndef EDGE_MAP_CODEC_HPP
+#define EDGE_MAP_CODEC_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief Magic number opening every encoded edge map ("LAFE").
+ */
+#define EDGEMAPMAGIC 0x4546414CU
+
+/**
+ * @brief Version of the edge map encoding.
+ */
+#define EDGEMAPVERSION 1
+
+/**
+ * @brief Size in bytes of the header of an encoded edge map.
+ */
+#define EDGEMAPHEADERSIZE 16
+
+/**
+ * @brief Largest number of pixels accepted when decoding, so a forged header cannot exhaust the memory.
+ */
+#define EDGEMAPMAXPIXELS (1ULL << 31)
+
+/**
+ * @brief MIME type of an encoded edge map.
+ */
+#define EDGEMAPCONTENTTYPE "application/x-edge-map"
+
+/**
+ * @brief Layout of the payload of an encoded edge map.
+ */
+enum class EdgeMapMode : std::uint8_t
+{
+    Packed = 0, /**< One bit per pixel in row major order, least significant bit first. */
+    Runs = 1,   /**< Lengths of the alternating runs of background and edge pixels, starting with background. */
+    Sparse = 2  /**< Gaps between the indices of the edge pixels in row major order. */
+};
+
+/**
+ * @brief A decoded edge map.
+ */
+struct EdgeMap
+{
+    std::uint32_t rows = 0;           /**< Height in pixels. */
+    std::uint32_t cols = 0;           /**< Width in pixels. */
+    std::vector<std::uint8_t> pixels; /**< One byte per pixel, 255 on the edges and 0 elsewhere. */
+};
+
+/**
+ * @brief Packs pixels to one bit each, least significant bit first, with SSE2 when available.
+ *
+ * @param pixels 8-bit pixels, any non zero pixel is an edge.
+ * @param count Number of pixels.
+ *
+ * @return The packed words, the bits past the last pixel are zero.
+ */
+std::vector<std::uint64_t> PackEdgePixels(const std::uint8_t* pixels, std::size_t count);
+
+/**
+ * @brief Encodes an edge map with the smallest of the three layouts.
+ *
+ * @param pixels Row major 8-bit pixels without padding, any non zero pixel is an edge.
+ * @param rows Height in pixels.
+ * @param cols Width in pixels.
+ *
+ * @return The encoded edge map.
+ *
+ * @details The pixels are first packed to one bit each with SSE2, 16 pixels per compare and movemask, which also
+ * gives the number of edges and of background/edge transitions by popcount. The run and sparse layouts, whose sizes
+ * are bounded below by those counts, are only built when they can beat the packed bitmap. Runs and gaps are written
+ * as LEB128 varints after a 16 byte little endian header holding the magic, version, layout and size.
+ */
+std::vector<char> EncodeEdgeMap(const std::uint8_t* pixels, std::uint32_t rows, std::uint32_t cols);
+
+/**
+ * @brief Encodes an edge map with the given layout.
+ *
+ * @param pixels Row major 8-bit pixels without padding, any non zero pixel is an edge.
+ * @param rows Height in pixels.
+ * @param cols Width in pixels.
+ * @param mode Layout of the payload.
+ *
+ * @return The encoded edge map.
+ */
+std::vector<char> EncodeEdgeMap(const std::uint8_t* pixels, std::uint32_t rows, std::uint32_t cols,
+                                EdgeMapMode mode);
+
+/**
+ * @brief Decodes an edge map.
+ *
+ * @param data The encoded edge map.
+ * @param size Size of the encoded edge map.
+ *
+ * @return The decoded edge map.
+ *
+ * @details This function throws a runtime error if the data is not a well formed edge map of a supported version.
+ */
+EdgeMap DecodeEdgeMap(const char* data, std::size_t size);
+
+#endif
@@ -0,0 +1,82 @@
+/**
+ * @file imageBlob.hpp
+ * @brief Immutable compressed image shared by every download in flight
+ */
+#ifndef IMAGE_BLOB_HPP
+#define IMAGE_BLOB_HPP
+
+#include "imageProtocol.hpp"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @class ImageBlob
+ *
+ * @brief A compressed image and its metadata, immutable once built.
+ *
+ * @details The bytes live in a single contiguous allocation that is never modified, so any number of senders can read
+ * it without locks while they hold a shared_ptr to the blob. A new image is published by swapping the pointer, and the
+ * old blob is freed when its last download finishes. The bytes are also stored in an in-memory file for zero-copy
+ * delivery with sendfile, when the system allows it.
+ */
+class ImageBlob
+{
+  public:
+    /**
+     * @brief Constructs a new ImageBlob object.
+     *
+     * @param data The compressed image, moved into the blob.
+     * @param version The version number of the image.
+     * @param encoding The encoding of the bytes, announced in the frames that carry them.
+     * @param inMemoryFile Whether to also store the bytes in an in-memory file for sendfile.
+     */
+    ImageBlob(std::vector<char>&& data, std::uint64_t version, FrameCompression encoding, bool inMemoryFile = true);
+    /**
+     * @brief Destroys the ImageBlob object and closes its in-memory file.
+     */
+    ~ImageBlob();
+
+    ImageBlob(const ImageBlob&) = delete;
+    ImageBlob& operator=(const ImageBlob&) = delete;
+
+    /**
+     * @brief Gets the bytes of the compressed image.
+     */
+    const char* data() const;
+    /**
+     * @brief Gets the size in bytes of the compressed image.
+     */
+    std::size_t size() const;
+    /**
+     * @brief Gets the content hash of the compressed image.
+     */
+    std::uint64_t hash() const;
+    /**
+     * @brief Gets the version number of the image.
+     */
+    std::uint64_t version() const;
+    /**
+     * @brief Gets the encoding of the bytes.
+     */
+    FrameCompression encoding() const;
+    /**
+     * @brief Gets the time the blob was built.
+     */
+    std::chrono::system_clock::time_point publishTime() const;
+    /**
+     * @brief Gets the in-memory file holding the bytes, or -1 if it could not be created.
+     */
+    int fd() const;
+
+  private:
+    const std::vector<char> m_data;                           /**< The compressed image. */
+    const std::uint64_t m_hash;                               /**< FNV-1a hash of the compressed image. */
+    const std::uint64_t m_version;                            /**< Version number of the image. */
+    const FrameCompression m_encoding;                        /**< Encoding of the bytes. */
+    const std::chrono::system_clock::time_point m_publishTime; /**< Time the blob was built. */
+    int m_fd;                                                 /**< In-memory file for sendfile, -1 if unavailable. */
+};
+
+#endif
@@ -0,0 +1,52 @@
+/**
+ * @file imageCompression.hpp
+ * @brief In-memory tar and gzip encoding of the images sent to the clients
+ */
+#ifndef IMAGE_COMPRESSION_HPP
+#define IMAGE_COMPRESSION_HPP
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Size of the blocks deflated in parallel.
+ */
+#define GZIPBLOCK (128 * 1024)
+
+/**
+ * @brief Size of a tar record.
+ */
+#define TARBLOCK 512
+
+/**
+ * @brief Builds a tar archive holding a single regular file.
+ *
+ * @param fileName Name of the file inside the archive.
+ * @param data Contents of the file.
+ * @param size Size of the contents.
+ *
+ * @return The archive, ustar formatted.
+ *
+ * @details This function writes the ustar header, the contents padded to a whole record and the two empty records
+ * that end the archive. It throws a runtime error if the name does not fit in the header.
+ */
+std::vector<char> BuildTarArchive(const std::string& fileName, const char* data, std::size_t size);
+
+/**
+ * @brief Compresses a buffer into a gzip stream using several threads.
+ *
+ * @param data Buffer to compress.
+ * @param size Size of the buffer.
+ * @param level zlib compression level.
+ * @param blockSize Size of the blocks compressed in parallel.
+ *
+ * @return The gzip stream.
+ *
+ * @details Like pigz, the input is split in blocks that are deflated in parallel with OpenMP. Every block is primed
+ * with the last 32 KiB of the previous one and, except the last, ends with a sync flush, so the raw deflate outputs
+ * concatenate into a single valid stream. The CRC of the blocks are computed in parallel and then combined.
+ */
+std::vector<char> GzipCompress(const char* data, std::size_t size, int level, std::size_t blockSize = GZIPBLOCK);
+
+#endif
@@ -0,0 +1,47 @@
+/**
+ * @file imageHttp.hpp
+ * @brief HTTP delivery of the published image and of its variants, with conditional requests
+ */
+#ifndef IMAGE_HTTP_HPP
+#define IMAGE_HTTP_HPP
+
+#include "httplib.h"
+#include "imageBlob.hpp"
+#include "variantCache.hpp"
+#include <memory>
+#include <string>
+
+/**
+ * @brief Size of the buffer of an HTTP date, like "Sun, 06 Nov 1994 08:49:37 GMT".
+ */
+#define HTTPDATEBUF 32
+
+/**
+ * @brief Checks the If-None-Match header of a request against the ETag of the current representation.
+ *
+ * @param header Value of the header: "*" or a comma separated list of entity tags.
+ * @param etag Quoted ETag of the representation.
+ *
+ * @return True if the list holds "*" or the ETag. Tags are compared whole and the W/ prefix of weak tags is ignored,
+ * as the weak comparison of If-None-Match asks. A malformed list matches nothing, so the full image is sent.
+ */
+bool MatchesIfNoneMatch(const std::string& header, const std::string& etag);
+
+/**
+ * @brief Answers a download of the published image or of one of its variants.
+ *
+ * @param req The HTTP request.
+ * @param res The HTTP response.
+ * @param image The published image.
+ * @param variantCache The variants of the published image.
+ *
+ * @details The encoded edge map is streamed straight from its blob with a content provider, with a strong ETag built
+ * from its content hash and its version and its publish time as Last-Modified. If the If-None-Match header of the
+ * request matches the ETag, it answers 304 without a body. Byte ranges are handled by the HTTP server. The width,
+ * format (png, webp, edge, targz or segments) and level parameters select a variant of the image instead, taken from
+ * the variant cache; the segments variant holds the vectorized edges as JSON, without the pixels.
+ */
+void ServeImage(const httplib::Request& req, httplib::Response& res, std::shared_ptr<const ImageBlob> image,
+                VariantCache& variantCache);
+
+#endif
@@ -0,0 +1,141 @@
+/**
+ * @file imageProtocol.hpp
+ * @brief Framing of the TCPv6 image channel, shared by the server and the client
+ */
+#ifndef IMAGE_PROTOCOL_HPP
+#define IMAGE_PROTOCOL_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Magic number opening every frame ("LAFS").
+ */
+#define FRAMEMAGIC 0x5346414CU
+
+/**
+ * @brief Version of the image channel protocol.
+ */
+#define PROTOCOLVERSION 2
+
+/**
+ * @brief Size in bytes of an encoded frame header.
+ */
+#define FRAMEHEADERSIZE 48
+
+/**
+ * @brief Kind of payload carried by a frame.
+ */
+enum class FrameType : std::uint8_t
+{
+    Hello = 1, /**< First frame of a connection, describes the current image and carries no payload. */
+    Image = 2  /**< A whole image, or the part of it starting at the frame offset. */
+};
+
+/**
+ * @brief Encoding of the image carried by a frame.
+ */
+enum class FrameCompression : std::uint8_t
+{
+    None = 0,    /**< Raw bytes. */
+    TarGzip = 1, /**< A tar archive holding the image, gzip compressed. */
+    EdgeMap = 2  /**< An edge map encoded with the edge map codec. */
+};
+
+/**
+ * @brief Header preceding every payload sent on the image channel.
+ *
+ * @details The header is encoded in little endian with a fixed size, so the receiver always reads FRAMEHEADERSIZE
+ * bytes and then exactly length bytes of payload. Several frames can follow each other on the same connection, and
+ * the offset and total size allow sending a part of an image.
+ */
+struct FrameHeader
+{
+    std::uint32_t magic = FRAMEMAGIC;                      /**< Always FRAMEMAGIC. */
+    std::uint8_t version = PROTOCOLVERSION;                /**< Protocol version of the sender. */
+    FrameType type = FrameType::Image;                     /**< Kind of payload. */
+    FrameCompression compression = FrameCompression::None; /**< Encoding of the image, set from the image sent. */
+    std::uint64_t imageId = 0;                             /**< Version number of the image, 0 if none. */
+    std::uint64_t hash = 0;                                /**< Content hash of the whole encoded image. */
+    std::uint64_t totalSize = 0;                           /**< Size of the whole encoded image. */
+    std::uint64_t offset = 0;                              /**< Position of the payload in the image. */
+    std::uint64_t length = 0;                              /**< Size of the payload following the header. */
+};
+
+/**
+ * @brief Encoded frame header.
+ */
+using FrameBytes = std::array<char, FRAMEHEADERSIZE>;
+
+namespace FrameDetail
+{
+inline void Put(FrameBytes& bytes, std::size_t position, std::uint64_t value, std::size_t width)
+{
+    for (std::size_t i = 0; i < width; ++i)
+    {
+        bytes[position + i] = static_cast<char>((value >> (8 * i)) & 0xff);
+    }
+}
+
+inline std::uint64_t Get(const FrameBytes& bytes, std::size_t position, std::size_t width)
+{
+    std::uint64_t value = 0;
+    for (std::size_t i = 0; i < width; ++i)
+    {
+        value |= static_cast<std::uint64_t>(static_cast<unsigned char>(bytes[position + i])) << (8 * i);
+    }
+    return value;
+}
+} // namespace FrameDetail
+
+/**
+ * @brief Encodes a frame header.
+ *
+ * @param header The header.
+ *
+ * @return The encoded header.
+ */
+inline FrameBytes EncodeFrameHeader(const FrameHeader& header)
+{
+    FrameBytes bytes {};
+    FrameDetail::Put(bytes, 0, header.magic, 4);
+    FrameDetail::Put(bytes, 4, header.version, 1);
+    FrameDetail::Put(bytes, 5, static_cast<std::uint8_t>(header.type), 1);
+    FrameDetail::Put(bytes, 6, static_cast<std::uint8_t>(header.compression), 1);
+    FrameDetail::Put(bytes, 8, header.imageId, 8);
+    FrameDetail::Put(bytes, 16, header.hash, 8);
+    FrameDetail::Put(bytes, 24, header.totalSize, 8);
+    FrameDetail::Put(bytes, 32, header.offset, 8);
+    FrameDetail::Put(bytes, 40, header.length, 8);
+    return bytes;
+}
+
+/**
+ * @brief Decodes a frame header.
+ *
+ * @param bytes The encoded header.
+ * @param header The decoded header.
+ *
+ * @return False if the bytes do not start a frame of a supported version, or if its type or encoding is unknown.
+ */
+inline bool DecodeFrameHeader(const FrameBytes& bytes, FrameHeader& header)
+{
+    header.magic = static_cast<std::uint32_t>(FrameDetail::Get(bytes, 0, 4));
+    header.version = static_cast<std::uint8_t>(FrameDetail::Get(bytes, 4, 1));
+    header.type = static_cast<FrameType>(FrameDetail::Get(bytes, 5, 1));
+    header.compression = static_cast<FrameCompression>(FrameDetail::Get(bytes, 6, 1));
+    header.imageId = FrameDetail::Get(bytes, 8, 8);
+    header.hash = FrameDetail::Get(bytes, 16, 8);
+    header.totalSize = FrameDetail::Get(bytes, 24, 8);
+    header.offset = FrameDetail::Get(bytes, 32, 8);
+    header.length = FrameDetail::Get(bytes, 40, 8);
+    const bool knownType = header.type == FrameType::Hello || header.type == FrameType::Image;
+    const bool knownCompression = header.compression == FrameCompression::None ||
+                                  header.compression == FrameCompression::TarGzip ||
+                                  header.compression == FrameCompression::EdgeMap;
+    return header.magic == FRAMEMAGIC && header.version == PROTOCOLVERSION && knownType && knownCompression &&
+           header.offset + header.length <= header.totalSize;
+}
+
+#endif
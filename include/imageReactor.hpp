@@ -0,0 +1,265 @@
+/**
+ * @file imageReactor.hpp
+ * @brief Event loop serving the TCPv6 image channel: accept, token handshake and image streaming
+ */
+#ifndef IMAGE_REACTOR_HPP
+#define IMAGE_REACTOR_HPP
+
+#include "imageBlob.hpp"
+#include "imageProtocol.hpp"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Default number of event loop threads.
+ */
+#define REACTORTHREADS 2
+
+/**
+ * @brief Maximum number of events handled per epoll_wait call.
+ */
+#define EPOLLEVENTS 64
+
+/**
+ * @brief Maximum size of the token sent by a client in the handshake.
+ */
+#define HANDSHAKEBUF 2048
+
+/**
+ * @brief Maximum number of image requests queued behind the transfer in progress of a connection.
+ */
+#define REACTORPENDING 4
+
+/**
+ * @class ImageReactor
+ *
+ * @brief Serves every client of the image channel from a few threads with non-blocking sockets and epoll.
+ *
+ * @details The listening socket is watched edge-triggered and every accepted connection is assigned to one of the
+ * event loop threads, which owns it until it closes. A connection first goes through the handshake: it is sent a
+ * Hello frame describing the current image and it answers with its token, which is handed to the token handler. After
+ * that it receives the images requested for it, each one as an Image frame. An image transfer keeps the image it
+ * started with and how much of its frame was sent, and each time the socket becomes writable the thread sends as much
+ * as the kernel accepts, so slow receivers only hold their own transfer. A request for a connection that is still
+ * receiving is queued behind the transfer in progress, with its offset; past REACTORPENDING queued requests the oldest
+ * one is dropped. When a connection that completed the handshake closes, the close handler is called with its socket
+ * before the socket is released, so the number cannot be reused in between. The only per-connection buffers are the
+ * fixed size frame headers and handshake buffer, images are sent from the shared blob.
+ */
+class ImageReactor
+{
+  public:
+    /**
+     * @brief Function returning the current image, or nullptr if none has been published yet.
+     */
+    using ImageProvider = std::function<std::shared_ptr<const ImageBlob>()>;
+    /**
+     * @brief Function called with the token of a client and its socket when the handshake completes.
+     */
+    using TokenHandler = std::function<void(const std::string&, int)>;
+
+    /**
+     * @brief Function called with the socket of a client that completed the handshake, before it is closed.
+     */
+    using CloseHandler = std::function<void(int)>;
+
+    /**
+     * @brief Constructs a new ImageReactor object and starts the event loop threads.
+     *
+     * @param currentImage The provider of the image described in the Hello frame.
+     * @param onToken The handler of the tokens received in the handshake.
+     * @param onClose The handler of the connections closed after the handshake, if any. It is not called for the
+     * connections still open when the reactor is destroyed.
+     * @param threads The number of event loop threads, at least one.
+     */
+    ImageReactor(ImageProvider currentImage, TokenHandler onToken, CloseHandler onClose = nullptr,
+                 std::size_t threads = REACTORTHREADS);
+    /**
+     * @brief Stops the event loop threads and closes the client connections.
+     */
+    ~ImageReactor();
+
+    ImageReactor(const ImageReactor&) = delete;
+    ImageReactor& operator=(const ImageReactor&) = delete;
+
+    /**
+     * @brief Starts accepting the connections of a listening socket.
+     *
+     * @param listenSocket The listening socket. It is switched to non-blocking mode and must outlive the reactor.
+     */
+    void listen(int listenSocket);
+
+    /**
+     * @brief Queues the delivery of an image to a client.
+     *
+     * @param socket The socket of the client, as given to the token handler.
+     * @param image The image to send.
+     * @param offset Number of bytes of the image the client already has, only the rest is sent.
+     */
+    void enqueue(int socket, std::shared_ptr<const ImageBlob> image, std::uint64_t offset = 0);
+
+  private:
+    /**
+     * @brief Step of a connection in the handshake.
+     */
+    enum class State
+    {
+        Greeting,     /**< Sending the Hello frame. */
+        ReadingToken, /**< Waiting for the token of the client. */
+        Ready         /**< Handshake done, images can be sent. */
+    };
+
+    /**
+     * @brief An image requested while another one is being sent.
+     */
+    struct QueuedImage
+    {
+        std::shared_ptr<const ImageBlob> image; /**< The image to send. */
+        std::uint64_t offset;                   /**< Position from which the image must be sent. */
+    };
+
+    /**
+     * @brief Progress of the delivery of an image to one client.
+     */
+    struct Transfer
+    {
+        std::shared_ptr<const ImageBlob> image; /**< The image being sent, nullptr if none. */
+        FrameBytes header;                      /**< Header of the frame carrying the image. */
+        std::size_t headerSent;                 /**< Number of bytes of the header already sent. */
+        off_t offset;                           /**< Position in the image of the next byte to send. */
+        std::deque<QueuedImage> pending;        /**< Images requested while this one was being sent, oldest first. */
+    };
+
+    /**
+     * @brief State of a client connection.
+     */
+    struct Connection
+    {
+        State state;              /**< Step of the handshake. */
+        FrameBytes greeting;      /**< The Hello frame. */
+        std::size_t greetingSent; /**< Number of bytes of the Hello frame already sent. */
+        Transfer transfer;        /**< Image delivery in progress. */
+    };
+
+    /**
+     * @brief Kind of the requests passed to an event loop thread.
+     */
+    enum class RequestType
+    {
+        Connect, /**< A connection was accepted. */
+        Send     /**< An image must be sent. */
+    };
+
+    /**
+     * @brief A request passed to an event loop thread.
+     */
+    struct Request
+    {
+        RequestType type;                       /**< Kind of the request. */
+        int socket;                             /**< Socket concerned. */
+        std::shared_ptr<const ImageBlob> image; /**< Image to send, if any. */
+        std::uint64_t offset;                   /**< Position from which the image must be sent. */
+    };
+
+    /**
+     * @brief An event loop thread and the connections it owns.
+     */
+    struct Worker
+    {
+        int epollFd;                                     /**< Epoll instance of the thread. */
+        int wakeFd;                                      /**< Eventfd signalling new requests. */
+        std::mutex mutex;                                /**< Protects the incoming requests. */
+        std::vector<Request> incoming;                   /**< Requests not yet picked up. */
+        std::unordered_map<int, Connection> connections; /**< Connections by socket. */
+        std::thread thread;                              /**< The event loop thread. */
+    };
+
+    ImageProvider m_currentImage;                   /**< Provider of the image announced in the handshake. */
+    TokenHandler m_onToken;                         /**< Handler of the tokens received in the handshake. */
+    CloseHandler m_onClose;                         /**< Handler of the connections closed after the handshake. */
+    std::vector<std::unique_ptr<Worker>> m_workers; /**< The event loop threads. */
+    std::atomic<int> m_listenSocket;                /**< The listening socket, -1 until listen is called. */
+    std::atomic<bool> m_running;                    /**< Cleared to stop the event loop threads. */
+
+    /**
+     * @brief Passes a request to the thread owning its socket.
+     *
+     * @param request The request.
+     */
+    void post(Request request);
+
+    /**
+     * @brief Event loop of a thread.
+     *
+     * @param worker The worker run by the thread.
+     */
+    void run(Worker& worker);
+
+    /**
+     * @brief Accepts the pending connections of the listening socket.
+     */
+    void acceptConnections();
+
+    /**
+     * @brief Handles the requests posted to a worker.
+     *
+     * @param worker The worker.
+     */
+    void takeRequests(Worker& worker);
+
+    /**
+     * @brief Advances a connection as far as its socket allows, closing it if it failed.
+     *
+     * @param worker The worker owning the connection.
+     * @param socket The socket of the connection.
+     */
+    void advance(Worker& worker, int socket);
+
+    /**
+     * @brief Closes a connection, calling the close handler first if it completed the handshake.
+     *
+     * @param worker The worker owning the connection.
+     * @param socket The socket of the connection.
+     */
+    void closeConnection(Worker& worker, int socket);
+
+    /**
+     * @brief Runs the handshake and the transfers of a connection until the socket would block.
+     *
+     * @param socket The socket of the connection.
+     * @param connection The connection.
+     *
+     * @return False if the connection failed or was closed by the client.
+     */
+    bool step(int socket, Connection& connection);
+
+    /**
+     * @brief Starts the transfer of an image, building the header of its frame.
+     *
+     * @param transfer The transfer, with no image in progress.
+     * @param image The image to send.
+     * @param offset Position from which the image must be sent.
+     */
+    static void startTransfer(Transfer& transfer, std::shared_ptr<const ImageBlob> image, std::uint64_t offset);
+
+    /**
+     * @brief Sends as much of a transfer as the socket accepts, moving on to the queued images when one finishes.
+     *
+     * @param socket The socket of the client.
+     * @param transfer The transfer.
+     *
+     * @return False if the transfer failed.
+     */
+    static bool pump(int socket, Transfer& transfer);
+};
+
+#endif
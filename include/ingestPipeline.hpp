@@ -0,0 +1,177 @@
+/**
+ * @file ingestPipeline.hpp
+ * @brief Staged pipeline turning the images dropped in a directory into published edge maps
+ */
+#ifndef INGEST_PIPELINE_HPP
+#define INGEST_PIPELINE_HPP
+
+#include "boundedQueue.hpp"
+#include "jobManager.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <opencv2/core/core.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Default capacity of the queues between the stages.
+ */
+#define PIPELINEQUEUE 4
+
+/**
+ * @brief Default number of decoding threads.
+ */
+#define DECODEWORKERS 2
+
+/**
+ * @brief Default number of encoding threads.
+ */
+#define ENCODEWORKERS 2
+
+/**
+ * @class IngestPipeline
+ *
+ * @brief Watches a directory and runs every new image through decode, Canny, encode and publish stages.
+ *
+ * @details The stages are linked by bounded queues and each one runs on its own threads, so the decoding of the next
+ * frame, the edge detection of the current one and the encoding of the previous one overlap. A full queue blocks the
+ * stage feeding it, which in the end leaves the pending inotify events in the kernel. Canny runs on a single thread,
+ * parallel inside with OpenMP, through a ChangeDetector that only recomputes the tiles that changed since the previous
+ * frame. Frames are numbered when they enter the pipeline, and a frame finishing after a newer one is not published.
+ * Given a job manager, every frame is tracked as a job whose progress follows the stages, so the clients can wait for
+ * the image being processed.
+ */
+class IngestPipeline
+{
+  public:
+    /**
+     * @brief Function receiving the edge map of a frame, owned by the frame and never modified, and its encoding.
+     */
+    using Publisher = std::function<void(const cv::Mat&, std::vector<char>&&)>;
+
+    /**
+     * @brief Constructs a new IngestPipeline object and starts the decode, Canny and encode threads.
+     *
+     * @param publish The function publishing the frames, called from the encoding threads.
+     * @param jobs The job manager tracking the frames, or nullptr. It must outlive the pipeline.
+     * @param queueCapacity The capacity of each queue between the stages.
+     * @param decodeWorkers The number of decoding threads.
+     * @param encodeWorkers The number of encoding threads.
+     */
+    explicit IngestPipeline(Publisher publish, JobManager* jobs = nullptr, std::size_t queueCapacity = PIPELINEQUEUE,
+                            std::size_t decodeWorkers = DECODEWORKERS, std::size_t encodeWorkers = ENCODEWORKERS);
+    /**
+     * @brief Stops the pipeline.
+     */
+    ~IngestPipeline();
+
+    IngestPipeline(const IngestPipeline&) = delete;
+    IngestPipeline& operator=(const IngestPipeline&) = delete;
+
+    /**
+     * @brief Starts watching a directory, creating it if needed.
+     *
+     * @param directory The directory. Every file closed after writing or moved into it is submitted, except the hidden
+     * ones, so writers can use a temporary dot file and rename it once complete.
+     *
+     * @details This method throws a runtime error if the directory cannot be watched or is already being watched.
+     */
+    void watch(const std::string& directory);
+
+    /**
+     * @brief Submits an image file, waiting while the decoding queue is full.
+     *
+     * @param path The path of the image.
+     *
+     * @return False if the pipeline is stopped.
+     */
+    bool submit(const std::string& path);
+
+    /**
+     * @brief Gets the job of the last submitted frame.
+     *
+     * @return The id of the job, empty if no frame was submitted or there is no job manager.
+     */
+    std::string lastJob() const;
+
+    /**
+     * @brief Stops watching, lets the frames in flight go through and joins every thread.
+     */
+    void stop();
+
+  private:
+    /**
+     * @brief A frame going through the pipeline.
+     */
+    struct Frame
+    {
+        std::uint64_t sequence; /**< Order of the frame in the pipeline. */
+        std::string path;       /**< The image file. */
+        std::string job;        /**< Id of the job tracking the frame, empty without job manager. */
+        cv::Mat image;          /**< The decoded image. */
+        cv::Mat edges;          /**< Its edge map. */
+    };
+
+    Publisher m_publish;                   /**< The function publishing the frames. */
+    JobManager* m_jobs;                    /**< The job manager tracking the frames, or nullptr. */
+    mutable std::mutex m_jobMutex;         /**< Protects the last job. */
+    std::string m_lastJob;                 /**< Id of the job of the last submitted frame. */
+    BoundedQueue<Frame> m_submitted;       /**< Frames waiting for decoding. */
+    BoundedQueue<Frame> m_decoded;         /**< Frames waiting for edge detection. */
+    BoundedQueue<Frame> m_detected;        /**< Frames waiting for encoding. */
+    std::atomic<std::uint64_t> m_sequence; /**< Number of frames submitted. */
+    std::mutex m_publishMutex;             /**< Orders the publications. */
+    std::uint64_t m_lastPublished;         /**< Sequence of the last frame published. */
+    std::mutex m_stopMutex;                /**< Serializes watch and stop. */
+    int m_stopFd;                          /**< Event file waking the watcher to stop it. */
+    std::thread m_watcher;                 /**< Thread reading the inotify events. */
+    std::vector<std::thread> m_decoders;   /**< Threads decoding the images. */
+    std::thread m_detector;                /**< Thread running Canny. */
+    std::vector<std::thread> m_encoders;   /**< Threads encoding and publishing the edge maps. */
+
+    /**
+     * @brief Reads the inotify events of a directory and submits the new files until stopped.
+     *
+     * @param inotifyFd The inotify instance watching the directory, closed on return.
+     * @param directory The directory.
+     */
+    void watchLoop(int inotifyFd, const std::string& directory);
+
+    /**
+     * @brief Decodes the submitted frames.
+     */
+    void decodeLoop();
+
+    /**
+     * @brief Computes the edge maps of the decoded frames.
+     */
+    void detectLoop();
+
+    /**
+     * @brief Encodes and publishes the edge maps.
+     */
+    void encodeLoop();
+
+    /**
+     * @brief Updates the job of a frame, if any.
+     *
+     * @param frame The frame.
+     * @param progress The progress of the frame, in percent.
+     */
+    void report(const Frame& frame, int progress);
+
+    /**
+     * @brief Ends the job of a frame, if any.
+     *
+     * @param frame The frame.
+     * @param state Done or Failed.
+     * @param error Why the frame failed, empty otherwise.
+     */
+    void finish(const Frame& frame, JobState state, const std::string& error = "");
+};
+
+#endif
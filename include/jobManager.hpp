@@ -0,0 +1,245 @@
+/**
+ * @file jobManager.hpp
+ * @brief Prioritized queue of the edge detection jobs uploaded by the clients
+ */
+#ifndef JOB_MANAGER_HPP
+#define JOB_MANAGER_HPP
+
+#include "cannyEdgeFilter.hpp"
+#include "imageBlob.hpp"
+#include "resultCache.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief Default number of jobs processed at the same time.
+ */
+#define JOBWORKERS 2
+
+/**
+ * @brief Default maximum number of jobs waiting to be processed.
+ */
+#define JOBQUEUELIMIT 16
+
+/**
+ * @brief Default number of finished jobs whose result is kept.
+ */
+#define JOBRETENTION 64
+
+/**
+ * @brief Nice value of the job threads, so the alerts and the requests are scheduled first.
+ */
+#define JOBNICE 10
+
+/**
+ * @brief Highest job priority.
+ */
+#define JOBMAXPRIORITY 9
+
+/**
+ * @brief Largest number of pixels of an uploaded image, checked before the full decode when the header allows it.
+ */
+#define UPLOADMAXPIXELS (100ULL * 1000 * 1000)
+
+/**
+ * @brief Progress of a job once its image is decoded, in percent.
+ */
+#define JOBDECODEPROGRESS 10
+
+/**
+ * @brief Share of the progress of a job taken by Canny, in percent.
+ */
+#define JOBCANNYPROGRESS 80
+
+/**
+ * @brief Step of a job.
+ */
+enum class JobState
+{
+    Queued,  /**< Waiting for a worker. */
+    Running, /**< Being processed. */
+    Done,    /**< Processed, the result is available. */
+    Failed   /**< The image could not be processed. */
+};
+
+/**
+ * @brief Gets the name of a job state, as shown to the clients.
+ */
+const char* JobStateName(JobState state);
+
+/**
+ * @brief State of a job as seen by the clients.
+ */
+struct JobStatus
+{
+    JobState state = JobState::Queued;       /**< Step of the job. */
+    int progress = 0;                        /**< Percentage of the job done. */
+    std::string error;                       /**< Why the job failed, empty otherwise. */
+    std::shared_ptr<const ImageBlob> result; /**< The encoded edge map once done, if the job keeps it. */
+};
+
+/**
+ * @class JobManager
+ *
+ * @brief Runs the edge detection of the images uploaded by the clients on a bounded set of low priority threads.
+ *
+ * @details Each job is an encoded image held in memory. It is decoded with OpenCV, goes through Canny and the edge map
+ * is encoded with the edge map codec, without touching the disk. Jobs are served by priority, then in submission
+ * order. The number of workers bounds the cores taken by the uploads and the workers run with a positive nice value,
+ * so a burst of uploads cannot starve the alert threads nor the HTTP server. The queue is bounded too, a job
+ * submitted while it is full is rejected. Only the last finished jobs are kept. Given a result cache, a job whose image
+ * and parameters were already processed is done as soon as it is submitted, without taking a place in the queue.
+ *
+ * Jobs run elsewhere, like the frames of the ingestion pipeline, can be tracked too: they get an id and report their
+ * progress and outcome through the same states, so the clients follow and await every job the same way.
+ */
+class JobManager
+{
+  public:
+    /**
+     * @brief Constructs a new JobManager object and starts the workers.
+     *
+     * @param workers The number of jobs processed at the same time, at least one.
+     * @param queueLimit The maximum number of jobs waiting to be processed.
+     * @param retention The number of finished jobs kept.
+     * @param results The cache of the results, or nullptr. It must outlive the manager.
+     */
+    explicit JobManager(std::size_t workers = JOBWORKERS, std::size_t queueLimit = JOBQUEUELIMIT,
+                        std::size_t retention = JOBRETENTION, ResultCache* results = nullptr);
+    /**
+     * @brief Stops the workers, dropping the jobs still queued.
+     */
+    ~JobManager();
+
+    JobManager(const JobManager&) = delete;
+    JobManager& operator=(const JobManager&) = delete;
+
+    /**
+     * @brief Queues a job.
+     *
+     * @param image The encoded image (PNG, JPEG, TIFF...).
+     * @param priority The priority of the job, from 0 to JOBMAXPRIORITY, clamped.
+     * @param parameters The Canny parameters, valid.
+     *
+     * @return The id of the job, or nullopt if the queue is full.
+     */
+    std::optional<std::string> submit(std::vector<char>&& image, int priority,
+                                      const CannyParameters& parameters = CannyParameters());
+
+    /**
+     * @brief Gets the state of a job.
+     *
+     * @param id The id of the job.
+     *
+     * @return The state of the job, or nullopt if it is unknown or was forgotten.
+     */
+    std::optional<JobStatus> status(const std::string& id) const;
+
+    /**
+     * @brief Waits for a job to finish or, if a progress is given, to move past it.
+     *
+     * @param id The id of the job.
+     * @param timeout The maximum time to wait.
+     * @param progress The progress the caller already knows, nullopt to wait for the end of the job.
+     *
+     * @return The state of the job when the wait ended, or nullopt if it is unknown or was forgotten.
+     */
+    std::optional<JobStatus> wait(const std::string& id, std::chrono::milliseconds timeout,
+                                  std::optional<int> progress = std::nullopt) const;
+
+    /**
+     * @brief Registers a job that is not run by the workers.
+     *
+     * @return The id of the job, queued.
+     */
+    std::string track();
+
+    /**
+     * @brief Updates the state and the progress of an unfinished job.
+     *
+     * @param id The id of the job.
+     * @param state Its new state.
+     * @param progress Its new progress, in percent.
+     */
+    void update(const std::string& id, JobState state, int progress);
+
+    /**
+     * @brief Records the outcome of a job and forgets the oldest finished jobs beyond the retention.
+     *
+     * @param id The id of the job.
+     * @param status Its final state.
+     */
+    void finish(const std::string& id, JobStatus&& status);
+
+  private:
+    /**
+     * @brief A queued job.
+     */
+    struct Job
+    {
+        std::string id;          /**< Id of the job. */
+        int priority;            /**< Priority of the job. */
+        std::uint64_t sequence;  /**< Submission order. */
+        std::vector<char> image; /**< The encoded image. */
+        ResultKey key;           /**< Identifies the result, with the Canny parameters. */
+    };
+
+    mutable std::mutex m_mutex;                          /**< Protects the queue and the states. */
+    std::condition_variable m_jobQueued;                 /**< Notified when a job is queued or on stop. */
+    mutable std::condition_variable m_jobChanged;        /**< Notified when the state of a job changes. */
+    std::vector<Job> m_queue;                            /**< Heap of the queued jobs, the next one first. */
+    std::unordered_map<std::string, JobStatus> m_status; /**< States of the known jobs. */
+    std::deque<std::string> m_finished;                  /**< Ids of the finished jobs, oldest first. */
+    std::size_t m_queueLimit;                            /**< Maximum number of queued jobs. */
+    std::size_t m_retention;                             /**< Number of finished jobs kept. */
+    ResultCache* m_results;                              /**< Cache of the results, or nullptr. */
+    std::uint64_t m_sequence;                            /**< Number of jobs submitted. */
+    std::mt19937_64 m_idGenerator;                       /**< Source of the job ids. */
+    bool m_stopping;                                     /**< Whether the workers must stop. */
+    std::vector<std::thread> m_workers;                  /**< The worker threads. */
+
+    /**
+     * @brief Heap order of the queued jobs: the highest priority, then the oldest, comes first.
+     *
+     * @param first A job.
+     * @param second Another job.
+     *
+     * @return True if the first job runs after the second one.
+     */
+    static bool runsAfter(const Job& first, const Job& second);
+
+    /**
+     * @brief Processes jobs until stopped.
+     */
+    void workerLoop();
+
+    /**
+     * @brief Creates a job id.
+     *
+     * @return A random id of 16 hexadecimal digits. The mutex must be held.
+     */
+    std::string newId();
+
+    /**
+     * @brief Decodes an image, detects its edges and encodes them, reporting the progress.
+     *
+     * @param job The job.
+     * @param edgeDetection The Canny engine of the worker, set to the parameters of the job.
+     *
+     * @return The encoded edge map, from the result cache if an identical job finished meanwhile.
+     */
+    std::shared_ptr<const ImageBlob> process(const Job& job, EdgeDetection& edgeDetection);
+};
+
+#endif
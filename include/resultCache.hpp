@@ -0,0 +1,161 @@
+/**
+ * @file resultCache.hpp
+ * @brief Cache of the edge maps computed for an image and a set of Canny parameters
+ */
+#ifndef RESULT_CACHE_HPP
+#define RESULT_CACHE_HPP
+
+#include "imageBlob.hpp"
+#include "lruCache.hpp"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+class RocksDbWrapper;
+
+/**
+ * @brief Low threshold of the Canny stage.
+ */
+#define CANNYLOW 40.0
+
+/**
+ * @brief High threshold of the Canny stage.
+ */
+#define CANNYHIGH 80.0
+
+/**
+ * @brief Gaussian sigma of the Canny stage.
+ */
+#define CANNYSIGMA 1.0
+
+/**
+ * @brief Largest Gaussian sigma accepted from the clients.
+ */
+#define CANNYMAXSIGMA 10.0
+
+/**
+ * @brief Default memory budget of the result cache, in bytes.
+ */
+#define RESULTBUDGET (64 * 1024 * 1024)
+
+/**
+ * @brief Path of the database persisting the results, apart from the state database.
+ */
+#define RESULTDBPATH "./ResultDatabase"
+
+/**
+ * @brief Size of the result database above which the oldest results are dropped, in bytes.
+ */
+#define RESULTSTOREBUDGET (512ULL * 1024 * 1024)
+
+/**
+ * @brief Prefix of the result keys in the database.
+ */
+#define RESULTPREFIX "result:"
+
+/**
+ * @brief Parameters of an edge detection.
+ */
+struct CannyParameters
+{
+    float low = CANNYLOW;     /**< Low hysteresis threshold. */
+    float high = CANNYHIGH;   /**< High hysteresis threshold. */
+    float sigma = CANNYSIGMA; /**< Standard deviation of the Gaussian blur. */
+
+    /**
+     * @brief Checks that the thresholds are ordered and positive and the sigma within (0, CANNYMAXSIGMA].
+     */
+    bool valid() const;
+};
+
+/**
+ * @brief Identifies an edge detection result.
+ */
+struct ResultKey
+{
+    std::uint64_t hash;         /**< Content hash of the encoded input image. */
+    std::size_t size;           /**< Size of the encoded input image. */
+    CannyParameters parameters; /**< Parameters of the detection. */
+
+    /**
+     * @brief Builds the key of an encoded image.
+     *
+     * @param data The encoded image.
+     * @param size Size of the encoded image.
+     * @param parameters Parameters of the detection.
+     */
+    static ResultKey of(const char* data, std::size_t size, const CannyParameters& parameters);
+
+    /**
+     * @brief Gets a string identifying the result, used as cache and database key. The parameters are written exactly.
+     */
+    std::string str() const;
+};
+
+/**
+ * @brief Counters of the result cache.
+ */
+struct ResultCacheStats
+{
+    std::uint64_t memoryHits; /**< Lookups served from memory. */
+    std::uint64_t storeHits;  /**< Lookups served from the database. */
+    std::uint64_t misses;     /**< Lookups that found nothing. */
+    std::size_t bytes;        /**< Bytes of results held in memory. */
+};
+
+/**
+ * @class ResultCache
+ *
+ * @brief Keeps the encoded edge maps already computed so identical requests skip the edge detection.
+ *
+ * @details Results are keyed by the content hash and the size of the encoded input and by the Canny parameters. The
+ * first tier is a least recently used cache bounded by a memory budget. The optional second tier persists the results
+ * in a RocksDB database of their own, so they survive restarts and evictions; a result found there is loaded back in
+ * memory. That database is expected to be bounded in size, like one opened with a size cap that drops the oldest
+ * results first. Hits of each tier and misses are counted.
+ */
+class ResultCache
+{
+  public:
+    /**
+     * @brief Constructs a new ResultCache object.
+     *
+     * @param budget Maximum number of bytes of results kept in memory.
+     * @param store The database persisting the results, or nullptr for a memory only cache. It must outlive the cache
+     * and only hold results, as its size cap evicts any key.
+     */
+    explicit ResultCache(std::size_t budget = RESULTBUDGET, RocksDbWrapper* store = nullptr);
+
+    /**
+     * @brief Looks up a result in memory, then in the database.
+     *
+     * @param key The result.
+     *
+     * @return The encoded edge map, or nullptr on a miss.
+     */
+    std::shared_ptr<const ImageBlob> get(const ResultKey& key);
+
+    /**
+     * @brief Stores a result in memory and in the database.
+     *
+     * @param key The result.
+     * @param result The encoded edge map.
+     */
+    void put(const ResultKey& key, const std::shared_ptr<const ImageBlob>& result);
+
+    /**
+     * @brief Gets the counters of the cache.
+     */
+    ResultCacheStats stats() const;
+
+  private:
+    LruCache<std::string, std::shared_ptr<const ImageBlob>> m_memory; /**< First tier. */
+    RocksDbWrapper* m_store;                                          /**< Second tier, or nullptr. */
+    std::atomic<std::uint64_t> m_memoryHits;                          /**< Lookups served from memory. */
+    std::atomic<std::uint64_t> m_storeHits;                           /**< Lookups served from the database. */
+    std::atomic<std::uint64_t> m_misses;                              /**< Lookups that found nothing. */
+};
+
+#endif
@@ -10,8 +10,16 @@
 #include "SuppliesData.h"
 #include "cannyEdgeFilter.hpp"
 #include "cppSocket.hpp"
+#include "edgeDensity.hpp"
 #include "httplib.h"
+#include "imageBlob.hpp"
+#include "imageHttp.hpp"
+#include "imageReactor.hpp"
+#include "ingestPipeline.hpp"
+#include "jobManager.hpp"
+#include "resultCache.hpp"
 #include "rocksDbWrapper.hpp"
+#include "variantCache.hpp"
 #include <array>
 #include <atomic>
 #include <chrono>
@@ -23,7 +31,6 @@
 #include <iostream>
 #include <map>
 #include <nlohmann/json.hpp>
-#include <queue>
 #include <random>
 #include <signal.h>
 #include <sstream>
@@ -94,6 +101,11 @@
  */
 #define IMAGEPATH "../imgtrial/testImage.png"
 
+/**
+ * @brief Directory watched for new images.
+ */
+#define WATCHDIR "../imgtrial/incoming"
+
 /**
  * @brief Destination image path.
  */
@@ -114,6 +126,21 @@
  */
 #define CONFPATH "../startproject/configuration.txt"
 
+/**
+ * @brief Maximum size of an uploaded image, in bytes.
+ */
+#define UPLOADMAXSIZE (32 * 1024 * 1024)
+
+/**
+ * @brief Longest wait of a job long-poll, in seconds.
+ */
+#define JOBMAXWAIT 30
+
+/**
+ * @brief Maximum number of job long-polls held at the same time, the next ones answer right away.
+ */
+#define JOBMAXWAITERS 4
+
 /**
  * @brief Logs an activity to a file.
  *
@@ -148,28 +175,17 @@ class Server
     std::mutex DbMutex;                        /**< A mutex for synchronizing database operations. */
     std::mutex ImgFlagMutex;                   /**< A mutex for synchronizing access to the image flags. */
     std::condition_variable fileReadCondition; /**< A condition variable for waiting for the file read to complete. */
+    std::atomic<std::shared_ptr<const ImageBlob>> image; /**< The image currently served to the clients. */
+    std::atomic<std::uint64_t> imageVersion;              /**< Version number of the last published image. */
+    std::unique_ptr<TCPv6Connection> imageListener;       /**< Listening connection of the image channel. */
+    ImageReactor imageReactor;                            /**< Serves the clients of the image channel. */
+    VariantCache variantCache;                            /**< Resized and re-encoded variants of the image. */
+    RocksDbWrapper resultDb;                              /**< Results of the uploads, bounded in size. */
+    ResultCache resultCache;                              /**< Edge maps already computed for the uploads. */
+    JobManager jobManager;                                /**< Edge detection jobs of the uploaded images. */
+    IngestPipeline pipeline;                              /**< Turns the incoming images into published ones. */
+    std::atomic<int> jobWaiters;                          /**< Number of job long-polls in progress. */
   public:
-    /**
-     * @brief Vector containing pieces of the image to send.
-     */
-    std::vector<std::vector<char>> chunks;
-    /**
-     * @brief Queue of image requests.
-     */
-    std::queue<std::pair<int, std::string>> imageRequestQueue;
-    /**
-     * @var std::mutex queueMutex
-     * @brief Mutex for synchronizing access to the image request queue.
-     *
-     */
-    std::mutex queueMutex;
-    /**
-     * @var std::condition_variable queueCondition
-     * @brief Condition variable for waiting for requests in the queue.
-     *
-     */
-    std::condition_variable queueCondition;
-
     /**
      * @brief Constructs a new Server object and initializes the database.
      *
@@ -198,14 +214,6 @@ class Server
      */
     std::string GenerateToken();
 
-    /**
-     * @brief Processes image requests from clients.
-     *
-     * @note This function should be run in a separate thread, as it contains an infinite loop that can block the main
-     * thread.
-     */
-    void ProcessImageRequests();
-
     /**
      * @brief Checks if a command is a valid modify command.
      *
@@ -235,7 +243,9 @@ class Server
      * @param LogMutex A mutex for logging.
      *
      * @details This method gets the token and command from the request, checks if the user is authorized to modify, and
-     * sends a response based on the command. It also logs the event.
+     * sends a response based on the command. It also logs the event. An image command may carry the content hash of
+     * the image the client holds and how many bytes of it it has: if the hash is the current one the image is not sent
+     * again, or only its missing part is. While the first image is processed, it answers with the id of its job.
      */
     void HandleCommand(const httplib::Request& req, httplib::Response& res, std::mutex& LogMutex);
 
@@ -257,6 +267,71 @@ class Server
      */
     void HandleAlertsCommand(const httplib::Request& req, httplib::Response& res, std::mutex& LogMutex);
 
+    /**
+     * @brief Handles the image download over HTTP.
+     *
+     * @param req The HTTP request.
+     * @param res The HTTP response.
+     *
+     * @details This method serves the current encoded edge map or one of its variants with ServeImage, which handles
+     * the ETag and the conditional requests. While the first image is processed, it answers 503 with its job as
+     * Location.
+     */
+    void HandleImageRequest(const httplib::Request& req, httplib::Response& res);
+
+    /**
+     * @brief Handles an image upload, queuing its edge detection.
+     *
+     * @param req The HTTP request.
+     * @param res The HTTP response.
+     * @param reader The reader of the request body.
+     * @param LogMutex A mutex for synchronizing access to the log file.
+     *
+     * @details The image is either the whole body, possibly chunked, or the "image" field of a multipart form. It is
+     * streamed into memory up to UPLOADMAXSIZE and queued in the job manager, and the job id is returned. The token
+     * parameter must belong to a logged in user. Privileged users can give a priority parameter, the others always get
+     * the lowest priority. The low, high and sigma parameters override the Canny parameters, invalid ones get 400.
+     * When the job queue is full the server answers 503 with Retry-After. An image already processed with the same
+     * parameters is served from the result cache, its job is done right away.
+     */
+    void HandleUploadRequest(const httplib::Request& req, httplib::Response& res, const httplib::ContentReader& reader,
+                             std::mutex& LogMutex);
+
+    /**
+     * @brief Handles a request for the state or the result of a job.
+     *
+     * @param req The HTTP request, whose first match is the job id and whose second match is "/result" for the result.
+     * @param res The HTTP response.
+     *
+     * @details The state and the progress are returned as JSON. With a wait parameter, in seconds up to JOBMAXWAIT,
+     * the answer is held until the job ends or, if a progress parameter is given too, until its progress differs from
+     * it, so the clients follow a job without polling. The result is the encoded edge map once the job is done, a
+     * redirection to /image for the jobs of the ingestion pipeline, 202 with Retry-After while it is queued or running
+     * and 422 with the error if it failed. Unknown jobs get 404.
+     */
+    void HandleJobRequest(const httplib::Request& req, httplib::Response& res);
+
+    /**
+     * @brief Handles a request for the server counters.
+     *
+     * @param req The HTTP request.
+     * @param res The HTTP response.
+     *
+     * @details The hits of each tier of the result cache, its misses and its memory use are returned as JSON.
+     */
+    void HandleMetricsRequest(const httplib::Request& req, httplib::Response& res);
+
+    /**
+     * @brief Handles a request for the edge density summary of the current image.
+     *
+     * @param req The HTTP request.
+     * @param res The HTTP response.
+     *
+     * @details The summary is read from the database as JSON, so it outlives restarts and costs nothing to serve. It
+     * answers 503 until the first image is published.
+     */
+    void HandleDensityRequest(const httplib::Request& req, httplib::Response& res);
+
     /**
      * @brief Handles a POST request.
      *
@@ -292,6 +367,16 @@ class Server
      */
     void SetTokenSocket(const std::string& token, int socket);
 
+    /**
+     * @brief Forgets a closed image channel.
+     *
+     * @param socket The socket of the channel.
+     *
+     * @details This method detaches the socket from its user in the user manager, so a later connection that gets the
+     * same number is not taken for the channel of that user.
+     */
+    void ReleaseTokenSocket(int socket);
+
     /**
      * @brief Gets the socket for a user.
      *
@@ -317,6 +402,52 @@ class Server
      * @details This method locks the image flag mutex and waits for the fileReadComplete flag to be true.
      */
     void waitForFileReadComplete();
+
+    /**
+     * @brief Publishes a new compressed image.
+     *
+     * @param edges The edge map, source of the image variants. It is shared, not copied, and must not be modified
+     * afterwards.
+     * @param data The compressed image.
+     *
+     * @details This method wraps the image in an ImageBlob with the next version number, swaps it atomically with the
+     * current one and notifies that the file read is complete. Downloads in flight keep the blob they started with.
+     * The edge density summary of the image is stored in the database under DENSITYKEY.
+     */
+    void publishImage(const cv::Mat& edges, std::vector<char>&& data);
+
+    /**
+     * @brief Serves the image channel on a listening connection.
+     *
+     * @param listener The bound connection. The server keeps it open from now on.
+     *
+     * @details The image reactor accepts the clients, runs the handshake that registers their token and socket, and
+     * streams the requested images, all on its own threads.
+     */
+    void listenImageChannel(std::unique_ptr<TCPv6Connection> listener);
+
+    /**
+     * @brief Runs an image through the ingestion pipeline and starts watching a directory for the next ones.
+     *
+     * @param imagePath The first image.
+     * @param directory The watched directory.
+     *
+     * @details This method throws a runtime error if the directory cannot be watched, the first image is processed
+     * anyway.
+     */
+    void startIngestion(const std::string& imagePath, const std::string& directory);
+
+    /**
+     * @brief Stops the ingestion pipeline, letting the images in flight be published.
+     */
+    void stopIngestion();
+
+    /**
+     * @brief Gets the image currently served to the clients.
+     *
+     * @return The current image, or nullptr if none has been published yet.
+     */
+    std::shared_ptr<const ImageBlob> currentImage() const;
 };
 
 /**
@@ -351,60 +482,13 @@ void RunEmergNotif(Server& server, std::mutex& LogMutex);
 void SignalHandlerFunction(int SigNum);
 
 /**
- * @brief Compresses an image and saves it to a file.
- *
- * @param inputPath A string representing the path of the input image.
- * @param outputPath A string representing the path to save the compressed image.
- *
- * @details This function reads the input image into a buffer, compresses the buffer, and writes the compressed data to
- * the output file. If an error occurs during any of these operations, it throws a runtime error.
- */
-void compressImage(const std::string& inputPath, const std::string& outputPath);
-
-/**
- * @brief Reads a file into chunks.
- *
- * @param filePath A string representing the path of the file to read.
- * @param chunkSize The size of the chunks to read the file into.
- *
- * @return A vector of vectors of characters representing the chunks of the file.
- *
- * @details This function opens the file, reads it into chunks of the specified size, and returns the chunks. If an
- * error occurs during opening the file, it throws a runtime error.
- */
-std::vector<std::vector<char>> readInChunks(const std::string& filePath, std::size_t chunkSize);
-
-/**
- * @brief Sends chunks of data to a TCPv6 client.
- *
- * @param server A reference to a Server object.
- * @param socket An integer representing the socket to send data through.
- * @param chunks A vector of vectors of characters representing the chunks of data to be sent.
-
- *
- * @details This function waits for the file read to complete and checks if the chunks are empty. If not, it enters a
- * loop where it continuously sends chunks of data to the client. The first time it sends data, it sends the username to
- * the client. After that, it sends the chunks of data. If the server's image flag for the username is set, it resets
- * the flag and starts sending data again. If an error occurs during sending or receiving data, it prints an error
- * message.
- */
-void SendChunksTCPv6(Server& server, int socket, const std::vector<std::vector<char>>& chunks);
-/**
- * @brief Handles the communication with a client over a socket.
- *
- * @param server The server that is communicating with the client.
- * @param clientSocket The socket of the client.
- *
- * @throws std::runtime_error If there is an error writing to or reading from the socket.
- */
-void SocketUsername(Server& server, int clientSocket);
-
-/**
- * @brief Establishes a connection to a TCPv6 client.
- *
+ * @brief Opens the TCPv6 image channel.
  *
  * @param server server
- * @exception std::exception Handles any exceptions thrown within the function and returns -1.
+ *
+ * @details This function binds the listening connection on the port of the configuration file and hands it to the
+ * server, whose image reactor accepts the clients. It returns once the channel is open.
+ * @exception std::exception Handles any exceptions thrown within the function and prints them.
  */
 void ConnectToTCPv6Client(Server& server);
 
@@ -448,17 +532,6 @@ class Timer
     bool mStopped;        /**< A flag indicating whether the timer has been stopped. */
 };
 
-/**
- * @brief Applies Canny edge detection to an image, compresses the image, and reads the compressed image into chunks.
- *
- * @param server A reference to a Server object.
- * @param chunkSize The size of the chunks to read the compressed image into.
- *
- * @details This function applies Canny edge detection to an image, compresses the image, and reads the compressed image
- * into chunks. If an error occurs during any of these operations, it prints an error message.
- */
-void CannyCompressAndRead(Server& server, std::size_t chunkSize);
-
 /**
  * @brief Reads the port from the third line of the given file.
  *
@@ -0,0 +1,163 @@
+/**
+ * @file variantCache.hpp
+ * @brief Cache of the resized and re-encoded variants of the published edge map
+ */
+#ifndef VARIANT_CACHE_HPP
+#define VARIANT_CACHE_HPP
+
+#include "edgeMapCodec.hpp"
+#include "imageBlob.hpp"
+#include "lruCache.hpp"
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <opencv2/core/core.hpp>
+#include <string>
+#include <unordered_map>
+
+/**
+ * @brief Default memory budget of the variant cache, in bytes.
+ */
+#define VARIANTBUDGET (64 * 1024 * 1024)
+
+/**
+ * @brief Name of the image inside the tar.gz variant.
+ */
+#define VARIANTTARNAME "canny.png"
+
+/**
+ * @brief MIME type of the edge segments variant.
+ */
+#define SEGMENTSCONTENTTYPE "application/json"
+
+/**
+ * @brief Encoding of an image variant.
+ */
+enum class VariantFormat
+{
+    Png,     /**< PNG, the level is the zlib compression level (0-9). */
+    Webp,    /**< WebP, the level is the quality (1-100, above 100 is lossless). */
+    EdgeMap, /**< Edge map codec, the level is ignored. */
+    TarGzip, /**< PNG in a tar archive, gzip compressed with the level (-1-9). */
+    Segments /**< Edge segments as JSON, the level is the polyline tolerance in tenths of a pixel. */
+};
+
+/**
+ * @brief Identifies an image variant.
+ */
+struct VariantKey
+{
+    std::uint64_t version; /**< Version of the published image the variant comes from. */
+    int width;             /**< Width of the variant in pixels, 0 keeps the full resolution. */
+    VariantFormat format;  /**< Encoding of the variant. */
+    int level;             /**< Compression level or quality, meaning depends on the format. */
+
+    /**
+     * @brief Gets a string identifying the variant, used as cache key and in the ETag.
+     */
+    std::string str() const;
+};
+
+/**
+ * @brief Parses a variant format name.
+ *
+ * @param name "png", "webp", "edge", "targz" or "segments".
+ * @param format The parsed format.
+ *
+ * @return False if the name is unknown.
+ */
+bool ParseVariantFormat(const std::string& name, VariantFormat& format);
+
+/**
+ * @brief Gets the level used for a variant format when the request does not give one.
+ */
+int DefaultVariantLevel(VariantFormat format);
+
+/**
+ * @brief Gets the MIME type of a variant format.
+ */
+const char* VariantContentType(VariantFormat format);
+
+/**
+ * @brief Encodes an edge map with the edge map codec.
+ *
+ * @param edges 8-bit single channel edge map, any non zero pixel is an edge.
+ *
+ * @return The encoded edge map.
+ */
+std::vector<char> EncodeEdgeMap(const cv::Mat& edges);
+
+/**
+ * @brief Encodes the connected edge segments of an edge map as JSON.
+ *
+ * @details The document is {"width", "height", "segments": [{"pixels", "length", "bbox": [x, y, w, h], "polyline":
+ * [x0, y0, x1, y1, ...]}]}, with flat arrays to keep it compact.
+ *
+ * @param edges 8-bit single channel edge map, any non zero pixel is an edge.
+ * @param epsilon Tolerance of the polylines, in pixels.
+ *
+ * @return The JSON document.
+ */
+std::vector<char> EncodeEdgeSegments(const cv::Mat& edges, double epsilon);
+
+/**
+ * @class VariantCache
+ *
+ * @brief Generates the variants of the published edge map on demand and keeps them under a memory budget.
+ *
+ * @details A variant is generated the first time it is requested and then served from the cache. Concurrent requests
+ * for the same variant share a single encoding through a shared future, while different variants are encoded in
+ * parallel by the threads requesting them. The least recently used variants are evicted when the budget is exceeded.
+ * Only variants of the current source image can be generated.
+ */
+class VariantCache
+{
+  public:
+    /**
+     * @brief Constructs a new VariantCache object.
+     *
+     * @param budget Maximum number of bytes of encoded variants kept.
+     */
+    explicit VariantCache(std::size_t budget = VARIANTBUDGET);
+
+    /**
+     * @brief Sets the edge map the variants are generated from.
+     *
+     * @param version Version of the published image.
+     * @param edges The edge map. It is shared, not copied, and must not be modified afterwards.
+     */
+    void setSource(std::uint64_t version, const cv::Mat& edges);
+
+    /**
+     * @brief Gets a variant, generating it if it is not cached.
+     *
+     * @param key The variant.
+     *
+     * @return The encoded variant, or nullptr if its version is not the current source.
+     *
+     * @details This method throws a runtime error if the encoding fails.
+     */
+    std::shared_ptr<const ImageBlob> get(const VariantKey& key);
+
+  private:
+    using Variant = std::shared_ptr<const ImageBlob>;
+
+    LruCache<std::string, Variant> m_cache;                           /**< Encoded variants. */
+    std::mutex m_mutex;                                               /**< Protects the source and the pending map. */
+    std::uint64_t m_sourceVersion;                                    /**< Version of the source edge map. */
+    cv::Mat m_source;                                                 /**< The source edge map. */
+    std::unordered_map<std::string, std::shared_future<Variant>> m_pending; /**< Variants being encoded. */
+
+    /**
+     * @brief Resizes and encodes a variant.
+     *
+     * @param source The source edge map.
+     * @param key The variant.
+     *
+     * @return The encoded variant.
+     */
+    static Variant encode(const cv::Mat& source, const VariantKey& key);
+};
+
+#endif
@@ -0,0 +1,93 @@
+/*
+ * LuckyAlgorithmForSatellites - autoThreshold
+ * Copyright (C) 2024, Operating Systems II.
+ * Apr 24, 2024.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ */
+
+#ifndef _AUTO_THRESHOLD_HPP
+#define _AUTO_THRESHOLD_HPP
+
+#include <array>
+#include <cstdint>
+
+/**
+ * @brief Number of bins of the histograms the thresholds are chosen from, one per 8-bit value.
+ */
+constexpr auto HISTOGRAM_BINS {256};
+
+/**
+ * @brief Spread around the median used by the median auto-threshold.
+ */
+constexpr auto AUTO_THRESHOLD_SIGMA {0.33};
+
+/**
+ * @brief Ratio of the low threshold to the high one chosen by Otsu or by percentile.
+ */
+constexpr auto AUTO_THRESHOLD_RATIO {0.5};
+
+/**
+ * @brief Share of the non zero values below the high threshold chosen by percentile.
+ */
+constexpr auto AUTO_THRESHOLD_PERCENTILE {0.9};
+
+/**
+ * @brief Counts of the 8-bit values of a plane.
+ */
+using Histogram = std::array<std::uint64_t, HISTOGRAM_BINS>;
+
+/**
+ * @brief Hysteresis thresholds.
+ */
+struct Thresholds
+{
+    float low;  ///< Low threshold.
+    float high; ///< High threshold.
+};
+
+/**
+ * @brief How EdgeDetection chooses its hysteresis thresholds.
+ */
+enum class ThresholdMode
+{
+    Fixed,     ///< The thresholds given to the engine.
+    Otsu,      ///< Otsu's method over the gradient magnitudes of each image.
+    Percentile ///< A percentile of the gradient magnitudes of each image.
+};
+
+/**
+ * @brief Chooses the thresholds with Otsu's method. Bin 0, the flat background, is ignored.
+ * @param histogram The histogram.
+ * @param ratio Ratio of the low threshold to the high one, the Otsu threshold.
+ * @return The thresholds, between 1 and 255.
+ */
+Thresholds otsuThresholds(const Histogram& histogram, double ratio = AUTO_THRESHOLD_RATIO);
+
+/**
+ * @brief Chooses the thresholds around the median. Bin 0, the flat background, is ignored.
+ * @param histogram The histogram.
+ * @param sigma Relative spread: the thresholds are (1 - sigma) and (1 + sigma) times the median.
+ * @return The thresholds, between 1 and 255.
+ */
+Thresholds medianThresholds(const Histogram& histogram, double sigma = AUTO_THRESHOLD_SIGMA);
+
+/**
+ * @brief Chooses the high threshold so a share of the values is below it. Bin 0, the flat background, is ignored.
+ * @param histogram The histogram.
+ * @param percentile Share of the non zero values below the high threshold, in [0, 1].
+ * @param ratio Ratio of the low threshold to the high one.
+ * @return The thresholds, between 1 and 255.
+ */
+Thresholds percentileThresholds(const Histogram& histogram, double percentile = AUTO_THRESHOLD_PERCENTILE,
+                                double ratio = AUTO_THRESHOLD_RATIO);
+
+#endif /* _AUTO_THRESHOLD_HPP */
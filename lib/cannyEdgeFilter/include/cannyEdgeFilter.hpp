@@ -17,11 +17,46 @@
 #ifndef _CANNY_EDGE_FILTER_HPP
 #define _CANNY_EDGE_FILTER_HPP
 
+#include "autoThreshold.hpp"
+#include "geoTiffWriter.hpp"
 #include "imageFileOperations.hpp"
+#include "preparedImage.hpp"
+#include "scratchArena.hpp"
+#include <functional>
 #include <opencv2/core/core.hpp>
+#include <vector>
+
+class SatelliteImageWrapper;
 
 constexpr auto KERNEL_SIZE {3};
 
+/**
+ * @brief Extra pixels read around a region of interest. The blur pads the window with zeros, and the Sobel and
+ * non-maximum suppression stages each reach one pixel further, so the suppressed gradient is exact from this distance
+ * inwards. That holds because every stage only looks at its neighbours: the gradient direction is mapped over the
+ * fixed range of atan2 rather than the range found in the image, and the hysteresis keeps every pixel above the low
+ * threshold without following its chain.
+ */
+constexpr auto ROI_HALO {KERNEL_SIZE / 2 + 2};
+
+/**
+ * @brief Progress reported after each stage of a detection, in percent.
+ */
+constexpr auto PROGRESS_BLUR {25};
+constexpr auto PROGRESS_SOBEL {50};
+constexpr auto PROGRESS_SUPPRESSION {75};
+constexpr auto PROGRESS_DONE {100};
+
+/**
+ * @brief Edge map of a region of interest.
+ */
+struct RoiEdges
+{
+    cv::Rect roi;           ///< Requested window, clipped to the frame.
+    cv::Mat edges;          ///< Edge map of the window.
+    std::size_t edgePixels; ///< Number of edge pixels in the window.
+};
+
 /**
  * @brief The EdgeDetection class applies Canny edge detection to an image.
  */
@@ -39,12 +74,104 @@ public:
 
     /**
      * @brief Applies Canny edge detection to an image.
+     *
+     * @details If the file did not change since the previous call and only the thresholds did, the blurred,
+     * gradient and suppressed planes of the previous call are reused and only the hysteresis runs again.
      * @param inputImage The input image file.
-     * @param outputImage The output image file.
+     * @param outputImage The output image file. A .tif or .tiff extension writes a tiled, compressed GeoTIFF with
+     * the georeferencing of the input image.
      */
     void cannyEdgeDetection(const std::string& inputImage, const std::string& outputImage);
 
+    /**
+     * @brief Applies Canny edge detection to an image already in memory.
+     * @param inputImage 8-bit single channel image; it may be a strided view, e.g. of a mapped file.
+     * @return The edge map, valid until the next detection.
+     */
+    const cv::Mat& detectEdges(const cv::Mat& inputImage);
+
+    /**
+     * @brief Runs the threshold independent stages on an image already in memory.
+     * @param inputImage 8-bit single channel image; it may be a strided view, e.g. of a mapped file.
+     * @return The prepared image, to threshold any number of times without this engine.
+     */
+    PreparedImage prepareImage(const cv::Mat& inputImage);
+
+    /**
+     * @brief Enables the memory-mapped input mode.
+     * @param enabled If true, uncompressed rasters are mapped instead of decoded and the pixels are read straight
+     * from the page cache. Files that cannot be mapped are decoded as usual.
+     */
+    void setMappedInput(bool enabled);
+
+    /**
+     * @brief Applies Canny edge detection only on some windows of an image.
+     * @param inputImage 8-bit single channel image.
+     * @param rois Windows to process; each one is extended by ROI_HALO pixels inside the frame.
+     * @return The edge map and edge pixel count of every window, in the same order.
+     */
+    std::vector<RoiEdges> detectEdges(const cv::Mat& inputImage, const std::vector<cv::Rect>& rois);
+
+    /**
+     * @brief Applies Canny edge detection on some windows of a satellite image, reading only those windows.
+     * @param image Satellite image to read from.
+     * @param bandNumber Band to process.
+     * @param rois Windows to process; each one is extended by ROI_HALO pixels inside the frame.
+     * @return The edge map and edge pixel count of every window, in the same order.
+     */
+    std::vector<RoiEdges> detectEdges(SatelliteImageWrapper& image, int bandNumber, const std::vector<cv::Rect>& rois);
+
+    /**
+     * @brief Enables writing the intermediate stages (blur, Sobel, suppression) as PNG files.
+     * @param enabled If true, every stage is written to the working directory. Enabled by default.
+     */
+    void setSaveStages(bool enabled);
+
+    /**
+     * @brief Sets the function told how far the detection went.
+     * @param callback Called on the detecting thread with the percentage done: PROGRESS_BLUR, PROGRESS_SOBEL and
+     * PROGRESS_SUPPRESSION after those stages and PROGRESS_DONE after the hysteresis. The ROI overloads call it after
+     * each window with the share of the windows done instead. An empty function disables the reports.
+     */
+    void setProgressCallback(std::function<void(int)> callback);
+
+    /**
+     * @brief Sets the options used when the edges are written as GeoTIFF.
+     * @param options Tiling and compression options.
+     */
+    void setGeoTiffOptions(const GeoTiffOptions& options);
+
+    /**
+     * @brief Changes the hysteresis thresholds.
+     * @param lowThreshold The lower threshold value for edge detection.
+     * @param highThreshold The higher threshold value for edge detection.
+     */
+    void setThresholds(float lowThreshold, float highThreshold);
+
+    /**
+     * @brief Chooses how the hysteresis thresholds are set.
+     * @param mode Fixed keeps the thresholds given to the engine. Otsu and Percentile choose them for every image from
+     * the histogram of its gradient magnitudes, built during the Sobel pass; the ROI overloads keep the thresholds of
+     * the previous image so the windows match the frame.
+     * @param percentile Share of the non zero magnitudes below the high threshold in Percentile mode.
+     */
+    void setThresholdMode(ThresholdMode mode, double percentile = AUTO_THRESHOLD_PERCENTILE);
+
+    /**
+     * @brief Gets the hysteresis thresholds, the ones chosen for the last image in the automatic modes.
+     */
+    Thresholds thresholds() const;
+
+    /**
+     * @brief Changes the standard deviation of the Gaussian kernel.
+     * @param sigma Standard deviation of the Gaussian kernel. The planes kept for a threshold-only rerun are not
+     * reused after a change.
+     */
+    void setSigma(float sigma);
+
 private:
+    friend class PreparedImage;
+
     float m_lowThreshold;
     float m_highThreshold;
     float m_sigma;
@@ -53,6 +180,17 @@ private:
     cv::Mat m_direction;
     cv::Mat m_cannyEdges;
     cv::Mat m_originalImage;
+    cv::Mat m_suppressed;
+    std::string m_preparedKey;
+    float m_preparedSigma;
+    ThresholdMode m_thresholdMode;
+    double m_percentile;
+    Histogram m_magnitudeHistogram; ///< Gradient magnitudes of the prepared image, saturated to 255.
+    GeoTiffOptions m_geoTiffOptions;
+    bool m_mappedInput;
+    bool m_saveStages;
+    std::function<void(int)> m_progress;
+    ScratchArena m_scratch; ///< Scratch planes kept from one frame to the next.
 
     /**
      * @brief Applies Gaussian blur to an image.
@@ -66,7 +204,8 @@ private:
      * @details This function applies Sobel operators to the input image to compute
      * the gradient magnitudes and directions. It convolves the image with
      * Sobel kernels for both x and y directions and then computes the
-     * magnitude and direction of the gradients.
+     * magnitude and direction of the gradients. The histogram of the magnitudes
+     * is counted in the same pass, in one copy per thread merged at the end.
      */
     void sobelOperator();
 
@@ -82,12 +221,17 @@ private:
      * @brief  Applies a double threshold and edge tracking by hysteresis to an edge map.
      * This function identifies strong edges and weak edges and attempts to
      * connect weak edges to strong edges to form continuous lines.
-     *
+     * @param edges The non-maximum suppressed plane, thresholded in place.
+     * @param lowThreshold The lower threshold value for edge detection.
+     * @param highThreshold The higher threshold value for edge detection.
+     * @param scratch Arena of the strong and weak edge planes, nullptr to allocate them.
      */
-    void applyLinkingAndHysteresis();
+    static void applyLinkingAndHysteresis(
+        cv::Mat& edges, float lowThreshold, float highThreshold, ScratchArena* scratch = nullptr);
 
     /**
      * @brief Checks the contours of the image.
+     * @param edges The edge map being thresholded.
      * @param strongEdges The strong edges of the image.
      * @param weakEdges The weak edges of the image.
      * @param row The row of the pixel.
@@ -95,7 +239,50 @@ private:
      * @param prevRow The previous row of the pixel.
      * @param prevCol The previous column of the pixel.
      */
-    void checkContours(cv::Mat& strongEdges, const cv::Mat& weakEdges, int row, int col, int prevRow, int prevCol);
+    static void checkContours(
+        cv::Mat& edges, cv::Mat& strongEdges, const cv::Mat& weakEdges, int row, int col, int prevRow, int prevCol);
+
+    /**
+     * @brief Runs the threshold independent stages (blur, Sobel and non-maximum suppression) and keeps their output.
+     * @param inputImage 8-bit single channel image.
+     */
+    void prepare(const cv::Mat& inputImage);
+
+    /**
+     * @brief Runs the hysteresis over the prepared planes with the current thresholds, chosen first in the automatic
+     * modes.
+     * @return The edge map.
+     */
+    const cv::Mat& applyThresholds();
+
+    /**
+     * @brief Writes the edge map to the output file.
+     * @param inputImage The input image file, used as georeferencing source for GeoTIFF outputs.
+     * @param outputImage The output image file.
+     */
+    void saveEdges(const std::string& inputImage, const std::string& outputImage);
+
+    /**
+     * @brief Reports the progress of the detection if a callback is set.
+     * @param percent Percentage of the detection done.
+     */
+    void reportProgress(int percent);
+
+    /**
+     * @brief Writes an intermediate stage if enabled.
+     * @param filename The output image file.
+     * @param image The stage to write.
+     */
+    void saveStage(const std::string& filename, const cv::Mat& image);
+
+    /**
+     * @brief Runs the pipeline on a window read with its halo and crops the region of interest.
+     * @param window Pixels of the halo rectangle.
+     * @param roi Region of interest, in frame coordinates.
+     * @param halo Rectangle the window was read from, in frame coordinates.
+     * @return The edges of the region of interest.
+     */
+    RoiEdges detectRoiEdges(const cv::Mat& window, const cv::Rect& roi, const cv::Rect& halo);
 };
 
 #endif /* _CANNY_EDGE_FILTER_HPP */
@@ -0,0 +1,83 @@
+/*
+ * LuckyAlgorithmForSatellites - changeDetector
+ * Copyright (C) 2024, Operating Systems II.
+ * Apr 24, 2024.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ */
+
+#ifndef _CHANGE_DETECTOR_HPP
+#define _CHANGE_DETECTOR_HPP
+
+#include "cannyEdgeFilter.hpp"
+#include <opencv2/core/core.hpp>
+#include <vector>
+
+constexpr auto CHANGE_TILE_SIZE {64};
+constexpr auto CHANGE_THRESHOLD {8.0};
+
+/**
+ * @brief Outcome of processing a frame with the ChangeDetector.
+ */
+struct ChangeDetectionResult
+{
+    cv::Mat edges;                 ///< Edge map of the whole frame.
+    cv::Mat tileMask;              ///< One 8-bit cell per tile, 255 where the tile changed.
+    std::vector<cv::Rect> changed; ///< Runs of adjacent changed tiles, in frame coordinates.
+    bool fullRecompute;            ///< True if the whole frame was processed.
+};
+
+/**
+ * @brief The ChangeDetector class recomputes the edges of a frame sequence only where the scene changed.
+ *
+ * @details Every frame is compared tile by tile with the frame the current edges were computed from, using the sum
+ * of absolute differences. A change moves the edges up to ROI_HALO pixels away, so Canny recomputes the changed
+ * tiles and the band of that width around them, and the rest of the edge map is reused. It matches a full detection
+ * of the frame because every stage is local, see ROI_HALO. Unchanged tiles keep their reference pixels, so slow
+ * drifts accumulate until they cross the threshold.
+ */
+class ChangeDetector
+{
+public:
+    /**
+     * @brief Constructor for the ChangeDetector class.
+     * @param tileSize Width and height of the compared tiles.
+     * @param threshold Mean absolute difference per pixel above which a tile is considered changed.
+     */
+    explicit ChangeDetector(int tileSize = CHANGE_TILE_SIZE, double threshold = CHANGE_THRESHOLD);
+
+    /**
+     * @brief Processes the next frame of the sequence.
+     * @param edgeDetection Engine used to recompute the changed tiles.
+     * @param frame 8-bit single channel frame.
+     * @return The edges of the frame and the regions that changed, valid until the next call.
+     */
+    const ChangeDetectionResult& process(EdgeDetection& edgeDetection, const cv::Mat& frame);
+
+    /**
+     * @brief Forgets the reference frame, so the next frame is processed in full.
+     */
+    void reset();
+
+private:
+    int m_tileSize;
+    double m_threshold;
+    cv::Mat m_reference;
+    ChangeDetectionResult m_result;
+
+    /**
+     * @brief Marks the tiles whose sum of absolute differences with the reference exceeds the threshold.
+     * @param frame The new frame, with the size of the reference.
+     */
+    void compareTiles(const cv::Mat& frame);
+};
+
+#endif /* _CHANGE_DETECTOR_HPP */
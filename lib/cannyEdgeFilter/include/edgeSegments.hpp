@@ -0,0 +1,61 @@
+/*
+ * LuckyAlgorithmForSatellites - edgeSegments
+ * Copyright (C) 2024, Operating Systems II.
+ * Apr 24, 2024.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ */
+
+#ifndef _EDGE_SEGMENTS_HPP
+#define _EDGE_SEGMENTS_HPP
+
+#include <cstddef>
+#include <opencv2/core/core.hpp>
+#include <vector>
+
+/**
+ * @brief Side of the square tiles labelled in parallel, in pixels.
+ */
+constexpr auto SEGMENT_TILE_SIZE {256};
+
+/**
+ * @brief Default tolerance of the polyline simplification, in pixels.
+ */
+constexpr auto SEGMENT_EPSILON {1.0};
+
+/**
+ * @brief A connected group of edge pixels, 8-connected.
+ */
+struct EdgeSegment
+{
+    cv::Rect bounds;                 ///< Bounding box of the pixels.
+    std::size_t pixels;              ///< Number of edge pixels.
+    double length;                   ///< Length along the edge, in pixels.
+    std::vector<cv::Point> polyline; ///< Simplified outline of the pixels.
+};
+
+/**
+ * @brief Extracts the connected edge segments of an edge map.
+ *
+ * @details The map is labelled in square tiles in parallel, then the labels touching across tile boundaries are
+ * merged with a union-find, so the result does not depend on the tile size. The polyline is the outline of the
+ * segment simplified with Douglas-Peucker; a one pixel wide edge is outlined along one side and back along the other,
+ * which is why its length is half the outline.
+ *
+ * @param edges 8-bit single channel edge map, any non zero pixel is an edge.
+ * @param epsilon Tolerance of the polyline simplification, in pixels. 0 keeps every outline pixel.
+ * @param tileSize Side of the tiles, in pixels.
+ * @return The segments, ordered by the tile and position of their first pixel.
+ */
+std::vector<EdgeSegment> extractEdgeSegments(const cv::Mat& edges, double epsilon = SEGMENT_EPSILON,
+                                             int tileSize = SEGMENT_TILE_SIZE);
+
+#endif /* _EDGE_SEGMENTS_HPP */
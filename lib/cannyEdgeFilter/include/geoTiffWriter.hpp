@@ -0,0 +1,130 @@
+/*
+ * LuckyAlgorithmForSatellites - geoTiffWriter
+ * Copyright (C) 2024, Operating Systems II.
+ * Apr 24, 2024.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ */
+
+#ifndef _GEO_TIFF_WRITER_HPP
+#define _GEO_TIFF_WRITER_HPP
+
+#include <array>
+#include <opencv2/core/core.hpp>
+#include <string>
+
+class GDALDataset;
+class SatelliteImageWrapper;
+
+/**
+ * @brief Compression codecs supported by the GeoTIFF writer.
+ */
+enum class GeoTiffCompression
+{
+    None,    ///< Uncompressed tiles.
+    Deflate, ///< zlib DEFLATE.
+    Lzw,     ///< Lempel-Ziv-Welch.
+    Zstd     ///< Zstandard (requires GDAL built with libzstd).
+};
+
+/**
+ * @brief TIFF predictors applied before compression.
+ */
+enum class GeoTiffPredictor
+{
+    None = 1,         ///< No prediction.
+    Horizontal = 2,   ///< Horizontal differencing, for integer samples.
+    FloatingPoint = 3 ///< Floating point prediction, for float samples.
+};
+
+/**
+ * @brief Creation options of a GeoTIFF file.
+ */
+struct GeoTiffOptions
+{
+    GeoTiffCompression compression {GeoTiffCompression::Deflate}; ///< Compression codec.
+    GeoTiffPredictor predictor {GeoTiffPredictor::Horizontal};    ///< Predictor used by the codec.
+    int level {-1};                                               ///< Codec level, -1 keeps the GDAL default.
+    int tileSize {256};                                           ///< Tile width and height, multiple of 16.
+    int threads {0};                                              ///< Compression threads, 0 uses all the CPUs.
+};
+
+/**
+ * @brief The GeoTiffWriter class writes images as tiled and compressed GeoTIFF files using GDAL.
+ *
+ * @details Blocks can be written incrementally with writeBlock(), so a streaming producer can emit strips or tiles
+ * as they are computed. GDAL compresses the tiles in parallel when they are flushed to disk.
+ */
+class GeoTiffWriter
+{
+public:
+    /**
+     * @brief Create a new GeoTIFF file.
+     * @param filename Path of the file to create.
+     * @param cols Width of the raster in pixels.
+     * @param rows Height of the raster in pixels.
+     * @param type OpenCV type of the samples (CV_8U, CV_16U, CV_16S, CV_32S or CV_32F, one band per channel).
+     * @param options Tiling and compression options.
+     */
+    GeoTiffWriter(const std::string& filename, int cols, int rows, int type, const GeoTiffOptions& options = {});
+
+    /**
+     * @brief Flush the pending tiles and close the file.
+     */
+    ~GeoTiffWriter();
+
+    GeoTiffWriter(const GeoTiffWriter&) = delete;
+    GeoTiffWriter& operator=(const GeoTiffWriter&) = delete;
+
+    /**
+     * @brief Copy the geotransform and projection of a source image.
+     * @param source Image whose georeferencing is copied.
+     * @return true if the source is georeferenced, false otherwise.
+     */
+    bool copyGeoreference(const SatelliteImageWrapper& source);
+
+    /**
+     * @brief Set the affine geotransform of the raster.
+     * @param geoTransform GDAL geotransform coefficients.
+     */
+    void setGeoTransform(const std::array<double, 6>& geoTransform);
+
+    /**
+     * @brief Set the spatial reference of the raster.
+     * @param projection Projection in WKT format.
+     */
+    void setProjection(const std::string& projection);
+
+    /**
+     * @brief Write a block of pixels at the given offset.
+     * @param xOffset Column of the top left pixel of the block.
+     * @param yOffset Row of the top left pixel of the block.
+     * @param block Pixels to write; it may be a strided view of a larger image.
+     */
+    void writeBlock(int xOffset, int yOffset, const cv::Mat& block);
+
+    /**
+     * @brief Write the whole raster.
+     * @param image Image with the size given on construction.
+     */
+    void write(const cv::Mat& image);
+
+    /**
+     * @brief Flush the written blocks to disk.
+     */
+    void flush();
+
+private:
+    GDALDataset* m_dataset;
+    int m_type;
+};
+
+#endif /* _GEO_TIFF_WRITER_HPP */
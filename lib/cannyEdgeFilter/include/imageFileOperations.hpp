@@ -17,9 +17,16 @@
 #ifndef _IMAGE_FILE_OPERATIONS_HPP
 #define _IMAGE_FILE_OPERATIONS_HPP
 
+#include "mappedImage.hpp"
+#include <memory>
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 
+/**
+ * @brief Default memory budget of the decoded image cache, in bytes.
+ */
+constexpr std::size_t DECODED_CACHE_BUDGET {256 * 1024 * 1024};
+
 /**
  * @brief The ImageFileOperations class provides methods to save and load images.
  */
@@ -36,9 +43,38 @@ public:
     /**
      * @brief Loads an image from a file.
      * @param filename The name of the file to load the image from.
-     * @return The loaded image.
+     * @return The loaded image. Decoded images are kept in a process-wide LRU cache keyed by path, modification time
+     * and size, so the returned image is shared with the cache and must not be modified.
      */
     cv::Mat loadImage(const std::string& filename);
+
+    /**
+     * @brief Decodes an image from a file without going through the decoded image cache.
+     * @param filename The name of the file to decode.
+     * @return The decoded image, owned by the caller. Meant for files read once, like the frames of a feed.
+     */
+    cv::Mat decodeImage(const std::string& filename);
+
+    /**
+     * @brief Sets the memory budget of the decoded image cache.
+     * @param bytes Maximum number of bytes of decoded pixels kept, 0 disables the cache.
+     */
+    static void setCacheBudget(std::size_t bytes);
+
+    /**
+     * @brief Builds the key identifying the current contents of a file.
+     * @param filename The name of the file.
+     * @return A key made of the path, modification time and size, empty if the file does not exist.
+     */
+    static std::string imageKey(const std::string& filename);
+
+    /**
+     * @brief Maps an uncompressed raster into memory without decoding it.
+     * @param filename Raw raster with an ENVI header (.hdr next to it) or uncompressed striped GeoTIFF.
+     * @return The mapped image, whose 8-bit single channel view reads the first band straight from the page cache.
+     * Pixel interleaved rasters gather the first band into a plane instead. Throws for rasters that are not 8-bit.
+     */
+    std::shared_ptr<MappedImage> mapImage(const std::string& filename);
 };
 
 #endif /* _IMAGE_FILE_OPERATIONS_HPP */
@@ -0,0 +1,150 @@
+/*
+ * LuckyAlgorithmForSatellites - lruCache
+ * Copyright (C) 2024, Operating Systems II.
+ * Apr 24, 2024.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ */
+
+#ifndef _LRU_CACHE_HPP
+#define _LRU_CACHE_HPP
+
+#include <cstddef>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+/**
+ * @brief Thread-safe least recently used cache bounded by a byte budget.
+ *
+ * @tparam Key Hashable key type.
+ * @tparam Value Value type, cheap to copy (e.g. a cv::Mat header or a shared_ptr).
+ */
+template <typename Key, typename Value>
+class LruCache
+{
+public:
+    /**
+     * @brief Constructor for the LruCache class.
+     * @param budget Maximum number of bytes held by the cache, 0 disables it.
+     */
+    explicit LruCache(std::size_t budget)
+        : m_budget(budget)
+        , m_bytes(0)
+    {
+    }
+
+    /**
+     * @brief Looks up a value and marks it as the most recently used.
+     * @param key Key of the value.
+     * @return The value, or nullopt on a miss.
+     */
+    std::optional<Value> get(const Key& key)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_index.find(key);
+        if (it == m_index.end())
+        {
+            return std::nullopt;
+        }
+        m_entries.splice(m_entries.begin(), m_entries, it->second);
+        return it->second->value;
+    }
+
+    /**
+     * @brief Inserts or replaces a value, evicting the least recently used ones to stay within the budget.
+     * @param key Key of the value.
+     * @param value Value to store.
+     * @param bytes Memory accounted to the value. Values larger than the budget are not stored.
+     */
+    void put(const Key& key, Value value, std::size_t bytes)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        erase(key);
+        if (bytes > m_budget)
+        {
+            return;
+        }
+        m_entries.push_front({key, std::move(value), bytes});
+        m_index[key] = m_entries.begin();
+        m_bytes += bytes;
+        evict();
+    }
+
+    /**
+     * @brief Changes the byte budget, evicting values if needed.
+     * @param budget Maximum number of bytes held by the cache, 0 disables it.
+     */
+    void setBudget(std::size_t budget)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_budget = budget;
+        evict();
+    }
+
+    /**
+     * @brief Gets the number of bytes accounted to the stored values.
+     */
+    std::size_t bytes() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_bytes;
+    }
+
+    /**
+     * @brief Removes every value.
+     */
+    void clear()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_entries.clear();
+        m_index.clear();
+        m_bytes = 0;
+    }
+
+private:
+    struct Entry
+    {
+        Key key;
+        Value value;
+        std::size_t bytes;
+    };
+
+    mutable std::mutex m_mutex;
+    std::size_t m_budget;
+    std::size_t m_bytes;
+    std::list<Entry> m_entries; ///< Most recently used first.
+    std::unordered_map<Key, typename std::list<Entry>::iterator> m_index;
+
+    void erase(const Key& key)
+    {
+        auto it = m_index.find(key);
+        if (it != m_index.end())
+        {
+            m_bytes -= it->second->bytes;
+            m_entries.erase(it->second);
+            m_index.erase(it);
+        }
+    }
+
+    void evict()
+    {
+        while (m_bytes > m_budget && !m_entries.empty())
+        {
+            m_bytes -= m_entries.back().bytes;
+            m_index.erase(m_entries.back().key);
+            m_entries.pop_back();
+        }
+    }
+};
+
+#endif /* _LRU_CACHE_HPP */
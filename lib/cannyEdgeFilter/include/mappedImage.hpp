@@ -0,0 +1,71 @@
+/*
+ * LuckyAlgorithmForSatellites - mappedImage
+ * Copyright (C) 2024, Operating Systems II.
+ * Apr 24, 2024.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ */
+
+#ifndef _MAPPED_IMAGE_HPP
+#define _MAPPED_IMAGE_HPP
+
+#include <cstddef>
+#include <opencv2/core/core.hpp>
+#include <string>
+
+/**
+ * @brief The MappedImage class exposes an uncompressed raster stored in a file as a zero-copy image view.
+ *
+ * @details The file is mapped read-only with mmap and the view points straight into the page cache, so no decoding
+ * or copy takes place. The view is only valid while the MappedImage object is alive and must not be written.
+ */
+class MappedImage
+{
+public:
+    /**
+     * @brief Map a raster stored in a file.
+     * @param filename File containing the raster.
+     * @param offset Byte offset of the first pixel in the file.
+     * @param rows Height of the raster in pixels.
+     * @param cols Width of the raster in pixels.
+     * @param type OpenCV type of the pixels.
+     * @param step Bytes between the start of two consecutive rows, 0 for packed rows.
+     */
+    MappedImage(const std::string& filename, std::size_t offset, int rows, int cols, int type, std::size_t step = 0);
+
+    /**
+     * @brief Unmap the file.
+     */
+    ~MappedImage();
+
+    MappedImage(const MappedImage&) = delete;
+    MappedImage& operator=(const MappedImage&) = delete;
+
+    /**
+     * @brief Get the image view over the mapped file.
+     * @return Read-only strided view of the raster.
+     */
+    const cv::Mat& view() const;
+
+    /**
+     * @brief Keep a single channel of pixel interleaved samples in the view.
+     * @param channel Channel to keep. A view cannot stride over the other channels of a pixel, so the channel is
+     * gathered from the mapping into a packed plane owned by this object.
+     */
+    void selectChannel(int channel);
+
+private:
+    void* m_mapping;
+    std::size_t m_length;
+    cv::Mat m_view;
+};
+
+#endif /* _MAPPED_IMAGE_HPP */
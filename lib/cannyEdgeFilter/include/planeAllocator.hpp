@@ -0,0 +1,119 @@
+/*
+ * LuckyAlgorithmForSatellites - planeAllocator
+ * Copyright (C) 2024, Operating Systems II.
+ * Apr 24, 2024.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ */
+
+#ifndef _PLANE_ALLOCATOR_HPP
+#define _PLANE_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <opencv2/core/core.hpp>
+
+/**
+ * @brief Size of a huge page, the granularity of the plane mappings.
+ */
+constexpr auto PLANE_HUGE_PAGE {std::size_t {2} << 20};
+
+/**
+ * @brief Smallest plane served by the pool, smaller ones go to the OpenCV allocator.
+ */
+constexpr auto PLANE_MIN_BYTES {std::size_t {4} << 20};
+
+/**
+ * @brief Largest amount of idle memory kept in the pool, in bytes.
+ */
+constexpr auto PLANE_POOL_BUDGET {std::size_t {1} << 30};
+
+/**
+ * @brief Counters of a PlaneAllocator.
+ */
+struct PlanePoolStats
+{
+    std::size_t mapped;      ///< Planes mapped from the kernel.
+    std::size_t reused;      ///< Planes served from the pool.
+    std::size_t pooledBytes; ///< Idle bytes kept in the pool.
+};
+
+/**
+ * @brief The PlaneAllocator class is an OpenCV allocator for the large planes of the edge detection.
+ *
+ * @details Planes are mapped in multiples of PLANE_HUGE_PAGE, aligned to it and backed by huge pages: explicit ones
+ * when the system has some reserved, transparent ones otherwise. A new mapping is first touched by the OpenMP
+ * threads with a static schedule, so on NUMA machines every page lands on the node of the thread that processes its
+ * rows. Released planes go back to a pool and are handed out again for the same size, already faulted in, so
+ * processing frames of a steady size makes no large allocation. The allocator must outlive the matrices it allocates.
+ */
+class PlaneAllocator : public cv::MatAllocator
+{
+public:
+    /**
+     * @brief Constructor for the PlaneAllocator class.
+     * @param budget Largest amount of idle memory kept in the pool, in bytes.
+     * @param minBytes Smallest plane served by the pool, in bytes.
+     */
+    explicit PlaneAllocator(std::size_t budget = PLANE_POOL_BUDGET, std::size_t minBytes = PLANE_MIN_BYTES);
+
+    /**
+     * @brief Unmap the pooled planes.
+     */
+    ~PlaneAllocator() override;
+
+    PlaneAllocator(const PlaneAllocator&) = delete;
+    PlaneAllocator& operator=(const PlaneAllocator&) = delete;
+
+    /**
+     * @brief Get the allocator shared by every edge detection engine.
+     */
+    static PlaneAllocator* instance();
+
+    /**
+     * @brief Allocate an uninitialized plane with this allocator.
+     * @param size Size of the plane.
+     * @param type OpenCV type of the pixels.
+     * @return The plane. Reallocations of it, by create or as an output array, also use this allocator.
+     */
+    cv::Mat plane(cv::Size size, int type);
+
+    /**
+     * @brief Unmap the pooled planes.
+     */
+    void trim();
+
+    /**
+     * @brief Get the counters of the allocator.
+     */
+    PlanePoolStats stats() const;
+
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step, cv::AccessFlag flags,
+                           cv::UMatUsageFlags usageFlags) const override;
+    bool allocate(cv::UMatData* data, cv::AccessFlag accessFlags, cv::UMatUsageFlags usageFlags) const override;
+    void deallocate(cv::UMatData* data) const override;
+
+private:
+    /**
+     * @brief Map a plane and fault its pages in from the OpenMP threads.
+     * @param bytes Size of the mapping, a multiple of PLANE_HUGE_PAGE.
+     */
+    static void* map(std::size_t bytes);
+
+    std::size_t m_budget;
+    std::size_t m_minBytes;
+    mutable std::mutex m_mutex;
+    mutable std::multimap<std::size_t, void*> m_pool; ///< Idle planes by mapping size.
+    mutable PlanePoolStats m_stats;
+};
+
+#endif /* _PLANE_ALLOCATOR_HPP */
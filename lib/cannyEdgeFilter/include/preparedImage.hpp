@@ -0,0 +1,82 @@
+/*
+ * LuckyAlgorithmForSatellites - preparedImage
+ * Copyright (C) 2024, Operating Systems II.
+ * Apr 24, 2024.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ */
+
+#ifndef _PREPARED_IMAGE_HPP
+#define _PREPARED_IMAGE_HPP
+
+#include "autoThreshold.hpp"
+#include <opencv2/core/core.hpp>
+
+/**
+ * @brief The PreparedImage class holds the non-maximum suppressed plane of an image, the output of every stage of
+ * the edge detection that does not depend on the thresholds.
+ *
+ * @details Thresholding a prepared image only runs the hysteresis, so sweeps over many thresholds cost a fraction of
+ * a full detection. The automatic thresholds come from the histogram of the gradient magnitudes counted during the
+ * Sobel pass, the same one the engine uses, so they take constant time and match the engine's automatic modes. The
+ * object is immutable: any number of threads can threshold it at the same time.
+ */
+class PreparedImage
+{
+public:
+    /**
+     * @brief Constructor for the PreparedImage class.
+     * @param suppressed 8-bit single channel non-maximum suppressed plane. It is shared, not copied, and must not be
+     * modified afterwards.
+     * @param magnitudeHistogram Histogram of the gradient magnitudes of the image, saturated to 255.
+     */
+    PreparedImage(const cv::Mat& suppressed, const Histogram& magnitudeHistogram);
+
+    /**
+     * @brief Gets the non-maximum suppressed plane.
+     */
+    const cv::Mat& suppressed() const;
+
+    /**
+     * @brief Runs the hysteresis with the given thresholds.
+     * @param lowThreshold The lower threshold value for edge detection, above 0.
+     * @param highThreshold The higher threshold value for edge detection.
+     * @return The edge map, the same EdgeDetection gives with these thresholds.
+     */
+    cv::Mat threshold(float lowThreshold, float highThreshold) const;
+
+    /**
+     * @brief Runs the hysteresis with the given thresholds.
+     * @param thresholds The thresholds.
+     * @return The edge map.
+     */
+    cv::Mat threshold(const Thresholds& thresholds) const;
+
+    /**
+     * @brief Chooses the thresholds with Otsu's method over the gradient magnitudes.
+     * @param ratio Ratio of the low threshold to the high one, the Otsu threshold.
+     * @return The thresholds, between 1 and 255.
+     */
+    Thresholds otsuThresholds(double ratio = AUTO_THRESHOLD_RATIO) const;
+
+    /**
+     * @brief Chooses the thresholds around the median of the gradient magnitudes.
+     * @param sigma Relative spread: the thresholds are (1 - sigma) and (1 + sigma) times the median.
+     * @return The thresholds, between 1 and 255.
+     */
+    Thresholds medianThresholds(double sigma = AUTO_THRESHOLD_SIGMA) const;
+
+private:
+    cv::Mat m_suppressed;
+    Histogram m_histogram; ///< Gradient magnitudes of the image, saturated to 255.
+};
+
+#endif /* _PREPARED_IMAGE_HPP */
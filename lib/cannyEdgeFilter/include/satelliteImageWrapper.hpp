@@ -17,8 +17,11 @@
 #ifndef _SATELLITE_IMAGE_WRAPPER_HPP
 #define _SATELLITE_IMAGE_WRAPPER_HPP
 
+#include "mappedImage.hpp"
+#include <array>
 #include <gdal_priv.h>
 #include <iostream>
+#include <memory>
 #include <opencv2/core/core.hpp>
 #include <string>
 
@@ -45,13 +48,48 @@ public:
      */
     cv::Mat readBand(int bandNumber);
 
+    /**
+     * @brief Read a window of a band, scaled to 8 bits like readBand()
+     * @param bandNumber Band number to read
+     * @param window Pixels to read, in band coordinates
+     */
+    cv::Mat readWindow(int bandNumber, const cv::Rect& window);
+
+    /**
+     * @brief Get the size of a band
+     * @param bandNumber Band number
+     * @return Width and height of the band
+     */
+    cv::Size bandSize(int bandNumber) const;
+
+    /**
+     * @brief Map a band of an uncompressed, striped 8-bit GeoTIFF without decoding it
+     * @param bandNumber Band number to map
+     * @return The mapped band, valid after this wrapper is destroyed
+     */
+    std::shared_ptr<MappedImage> mapBand(int bandNumber);
+
     /**
      * @brief Check if the image is valid
      * @return true if the image is valid, false otherwise
      */
     bool isValid() const;
 
+    /**
+     * @brief Get the affine geotransform of the image
+     * @param geoTransform Output GDAL geotransform coefficients
+     * @return true if the image is georeferenced, false otherwise
+     */
+    bool getGeoTransform(std::array<double, 6>& geoTransform) const;
+
+    /**
+     * @brief Get the spatial reference of the image
+     * @return Projection in WKT format, empty if the image has none
+     */
+    std::string getProjection() const;
+
 private:
+    std::string m_filename;
     GDALDataset* m_dataset;
 };
 
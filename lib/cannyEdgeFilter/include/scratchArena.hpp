@@ -0,0 +1,79 @@
+/*
+ * LuckyAlgorithmForSatellites - scratchArena
+ * Copyright (C) 2024, Operating Systems II.
+ * Apr 24, 2024.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ */
+
+#ifndef _SCRATCH_ARENA_HPP
+#define _SCRATCH_ARENA_HPP
+
+#include <array>
+#include <cstddef>
+#include <opencv2/core/core.hpp>
+
+/**
+ * @brief The scratch planes of an edge detection engine.
+ */
+enum class ScratchPlane
+{
+    Blur,      ///< Input with the borders of the Gaussian kernel.
+    Kernel,    ///< Gaussian kernel.
+    GradientX, ///< Horizontal Sobel gradient.
+    GradientY, ///< Vertical Sobel gradient.
+    Magnitude, ///< Gradient magnitude.
+    Direction, ///< Gradient direction.
+    Strong,    ///< Strong edges of the hysteresis.
+    Weak,      ///< Weak edges of the hysteresis.
+    Count      ///< Number of planes.
+};
+
+/**
+ * @brief The ScratchArena class keeps the scratch planes of an engine from one frame to the next.
+ *
+ * @details Every plane is allocated once for the largest frame seen and smaller frames get a view of its top left
+ * corner, so a feed of frames makes no allocation and faults no page in once the largest one went through. Views
+ * share ownership of their plane, they stay valid when the plane grows, but they are overwritten by the next user of
+ * the same plane. An arena belongs to one engine: copies start empty instead of sharing the planes.
+ */
+class ScratchArena
+{
+public:
+    ScratchArena() = default;
+
+    ScratchArena(const ScratchArena&);
+    ScratchArena& operator=(const ScratchArena&);
+
+    /**
+     * @brief Get a view of a scratch plane.
+     * @param plane The plane.
+     * @param size Size of the view.
+     * @param type OpenCV type of the pixels. The plane is allocated again when it changes.
+     * @return The uninitialized view, not continuous when it is narrower than the plane.
+     */
+    cv::Mat view(ScratchPlane plane, cv::Size size, int type);
+
+    /**
+     * @brief Get the memory held by the planes, in bytes.
+     */
+    std::size_t bytes() const;
+
+    /**
+     * @brief Release the planes.
+     */
+    void release();
+
+private:
+    std::array<cv::Mat, static_cast<std::size_t>(ScratchPlane::Count)> m_planes;
+};
+
+#endif /* _SCRATCH_ARENA_HPP */
@@ -0,0 +1,115 @@
+/*
+ * LuckyAlgorithmForSatellites - autoThreshold
+ * Copyright (C) 2024, Operating Systems II.
+ * Apr 24, 2024.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ */
+
+#include "autoThreshold.hpp"
+#include <algorithm>
+
+namespace
+{
+std::uint64_t nonZeroCount(const Histogram& histogram)
+{
+    std::uint64_t count = 0;
+    for (int value = 1; value < HISTOGRAM_BINS; ++value)
+    {
+        count += histogram[value];
+    }
+    return count;
+}
+
+int quantile(const Histogram& histogram, std::uint64_t count, double share)
+{
+    std::uint64_t seen = 0;
+    for (int value = 1; value < HISTOGRAM_BINS; ++value)
+    {
+        seen += histogram[value];
+        if (seen >= share * count)
+        {
+            return value;
+        }
+    }
+    return HISTOGRAM_BINS - 1;
+}
+
+Thresholds fromHigh(double high, double ratio)
+{
+    const auto clampedHigh = std::clamp(static_cast<float>(high), 1.0F, 255.0F);
+    return {std::clamp(static_cast<float>(ratio * clampedHigh), 1.0F, clampedHigh), clampedHigh};
+}
+} // namespace
+
+Thresholds otsuThresholds(const Histogram& histogram, double ratio)
+{
+    const std::uint64_t count = nonZeroCount(histogram);
+    if (count == 0)
+    {
+        return {1.0F, 1.0F};
+    }
+
+    double totalSum = 0;
+    for (int value = 1; value < HISTOGRAM_BINS; ++value)
+    {
+        totalSum += static_cast<double>(value) * histogram[value];
+    }
+
+    // Class 1 holds the values up to t, class 2 the ones above, the best t maximizes the variance between them
+    double weight1 = 0;
+    double sum1 = 0;
+    double bestVariance = -1;
+    int best = 1;
+    for (int value = 1; value < HISTOGRAM_BINS - 1; ++value)
+    {
+        weight1 += histogram[value];
+        sum1 += static_cast<double>(value) * histogram[value];
+        const double weight2 = count - weight1;
+        if (weight1 == 0 || weight2 == 0)
+        {
+            continue;
+        }
+        const double mean1 = sum1 / weight1;
+        const double mean2 = (totalSum - sum1) / weight2;
+        const double variance = weight1 * weight2 * (mean1 - mean2) * (mean1 - mean2);
+        if (variance > bestVariance)
+        {
+            bestVariance = variance;
+            best = value;
+        }
+    }
+    return fromHigh(best + 1, ratio);
+}
+
+Thresholds medianThresholds(const Histogram& histogram, double sigma)
+{
+    const std::uint64_t count = nonZeroCount(histogram);
+    if (count == 0)
+    {
+        return {1.0F, 1.0F};
+    }
+
+    const int median = quantile(histogram, count, 0.5);
+    const auto low = std::clamp(static_cast<float>((1.0 - sigma) * median), 1.0F, 255.0F);
+    const auto high = std::clamp(static_cast<float>((1.0 + sigma) * median), low, 255.0F);
+    return {low, high};
+}
+
+Thresholds percentileThresholds(const Histogram& histogram, double percentile, double ratio)
+{
+    const std::uint64_t count = nonZeroCount(histogram);
+    if (count == 0)
+    {
+        return {1.0F, 1.0F};
+    }
+    return fromHigh(quantile(histogram, count, std::clamp(percentile, 0.0, 1.0)), ratio);
+}
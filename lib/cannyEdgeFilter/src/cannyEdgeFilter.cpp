@@ -15,20 +15,50 @@
  */
 
 #include "cannyEdgeFilter.hpp"
+#include "planeAllocator.hpp"
+#include "satelliteImageWrapper.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <filesystem>
 #include <iostream>
+#include <iterator>
+
+namespace
+{
+cv::Rect haloRect(const cv::Rect& roi, const cv::Rect& frame)
+{
+    return cv::Rect(roi.x - ROI_HALO, roi.y - ROI_HALO, roi.width + 2 * ROI_HALO, roi.height + 2 * ROI_HALO) & frame;
+}
+
+void reallocatePlane(cv::Mat& plane, cv::Size size, int type)
+{
+    // Release first, so the pool hands the pages of the previous run back
+    plane.release();
+    plane = PlaneAllocator::instance()->plane(size, type);
+}
+} // namespace
 
 EdgeDetection::EdgeDetection(float lowThreshold, float highThreshold, float sigma)
     : m_lowThreshold(lowThreshold)
     , m_highThreshold(highThreshold)
     , m_sigma(sigma)
+    , m_imageFileOperations(std::make_shared<ImageFileOperations>())
+    , m_preparedSigma(0)
+    , m_thresholdMode(ThresholdMode::Fixed)
+    , m_percentile(AUTO_THRESHOLD_PERCENTILE)
+    , m_magnitudeHistogram {}
+    , m_mappedInput(false)
+    , m_saveStages(true)
 {
 }
 
 void EdgeDetection::applyGaussianBlur()
 {
-    cv::Mat image_tmp(
-        m_originalImage.rows + KERNEL_SIZE - 1, m_originalImage.cols + KERNEL_SIZE - 1, m_originalImage.type());
-    cv::Mat kernel(KERNEL_SIZE, KERNEL_SIZE, CV_64F);
+    cv::Mat image_tmp = m_scratch.view(
+        ScratchPlane::Blur,
+        cv::Size(m_originalImage.cols + KERNEL_SIZE - 1, m_originalImage.rows + KERNEL_SIZE - 1),
+        m_originalImage.type());
+    cv::Mat kernel = m_scratch.view(ScratchPlane::Kernel, cv::Size(KERNEL_SIZE, KERNEL_SIZE), CV_64F);
     double kmean = KERNEL_SIZE / 2;
     double kaccum = 0;
     int border_val = 0;
@@ -114,7 +144,7 @@ void EdgeDetection::applyGaussianBlur()
         }
     }
 
-    m_imageFileOperations->saveImage("CannyImage.png", m_cannyEdges);
+    saveStage("CannyImage.png", m_cannyEdges);
 }
 
 void EdgeDetection::sobelOperator()
@@ -128,10 +158,14 @@ void EdgeDetection::sobelOperator()
     const int8_t sobelX[3][3] = {{-1, 0, 1}, {-2, 0, 2}, {-1, 0, 1}};
     const int8_t sobelY[3][3] = {{1, 2, 1}, {0, 0, 0}, {-1, -2, -1}};
 
-    cv::Mat gradientX(rows, cols, CV_32F, cv::Scalar(0));
-    cv::Mat gradientY(rows, cols, CV_32F, cv::Scalar(0));
+    cv::Mat gradientX = m_scratch.view(ScratchPlane::GradientX, cv::Size(cols, rows), CV_32F);
+    cv::Mat gradientY = m_scratch.view(ScratchPlane::GradientY, cv::Size(cols, rows), CV_32F);
+    gradientX.setTo(0);
+    gradientY.setTo(0);
+    std::uint64_t histogram[HISTOGRAM_BINS] = {};
 
-#pragma omp parallel for collapse(2)
+    // Each thread counts into its own copy of the histogram, OpenMP adds the copies up once the loop is done
+#pragma omp parallel for collapse(2) reduction(+ : histogram[:HISTOGRAM_BINS])
     for (int rowIndex = 1; rowIndex < rows - 1; ++rowIndex)
     {
         for (int colIndex = 1; colIndex < cols - 1; ++colIndex)
@@ -151,10 +185,14 @@ void EdgeDetection::sobelOperator()
             gradientX.at<float>(rowIndex, colIndex) = gx;
             gradientY.at<float>(rowIndex, colIndex) = gy;
 
-            m_magnitude.at<float>(rowIndex, colIndex) = std::sqrt(gx * gx + gy * gy);
-            m_direction.at<float>(rowIndex, colIndex) = std::atan2(gy, gx);
+            const float magnitude = std::sqrt(gx * gx + gy * gy);
+            m_magnitude.at<float>(rowIndex, colIndex) = magnitude;
+            // A fixed range keeps the angle of a pixel independent of the rest of the image, as in a window
+            m_direction.at<float>(rowIndex, colIndex) = (std::atan2(gy, gx) + M_PI) * 255 / (2 * M_PI);
+            ++histogram[static_cast<int>(std::min(magnitude, 255.0F))];
         }
     }
+    std::copy(std::begin(histogram), std::end(histogram), m_magnitudeHistogram.begin());
 
     m_magnitude.row(0).setTo(0);
     m_magnitude.row(rows - 1).setTo(0);
@@ -166,10 +204,8 @@ void EdgeDetection::sobelOperator()
     m_direction.col(0).setTo(0);
     m_direction.col(cols - 1).setTo(0);
 
-    cv::normalize(m_direction, m_direction, 0, 255, cv::NORM_MINMAX);
-
-    m_imageFileOperations->saveImage("sobelDirection.png", m_direction);
-    m_imageFileOperations->saveImage("sobelMagnitude.png", m_magnitude);
+    saveStage("sobelDirection.png", m_direction);
+    saveStage("sobelMagnitude.png", m_magnitude);
 }
 
 void EdgeDetection::nonMaximumSuppression()
@@ -185,7 +221,7 @@ void EdgeDetection::nonMaximumSuppression()
             float neighbor_q = 255;
             float neighbor_r = 255;
 
-            float angle = (m_direction.at<float>(i, j) - 128) * 180.0 / 128;
+            float angle = m_direction.at<float>(i, j) * 360.0 / 255 - 180;
             if (angle < 0)
             {
                 angle += 180;
@@ -229,11 +265,11 @@ void EdgeDetection::nonMaximumSuppression()
     m_cannyEdges.col(0).setTo(0);
     m_cannyEdges.col(cols - 1).setTo(0);
 
-    m_imageFileOperations->saveImage("maxsupress.png", m_cannyEdges);
+    saveStage("maxsupress.png", m_cannyEdges);
 }
 
 void EdgeDetection::checkContours(
-    cv::Mat& strongEdges, const cv::Mat& weakEdges, int row, int col, int prevRow, int prevCol)
+    cv::Mat& edges, cv::Mat& strongEdges, const cv::Mat& weakEdges, int row, int col, int prevRow, int prevCol)
 {
     // Return if the bridge is completed
     if (strongEdges.at<bool>(row, col))
@@ -244,7 +280,7 @@ void EdgeDetection::checkContours(
     // If there is no weak contour clear the pixel
     if (!(strongEdges.at<bool>(row, col) = weakEdges.at<bool>(row, col)))
     {
-        m_cannyEdges.at<uint8_t>(row, col) = 0;
+        edges.at<uint8_t>(row, col) = 0;
         return;
     }
 
@@ -255,29 +291,34 @@ void EdgeDetection::checkContours(
         {
             if ((side_col != prevCol && side_row != prevRow) && (side_col != col && side_row != row))
             {
-                checkContours(strongEdges, weakEdges, side_row, side_col, row, col);
+                checkContours(edges, strongEdges, weakEdges, side_row, side_col, row, col);
             }
         }
     }
 }
 
-void EdgeDetection::applyLinkingAndHysteresis()
+void EdgeDetection::applyLinkingAndHysteresis(
+    cv::Mat& edges, float lowThreshold, float highThreshold, ScratchArena* scratch)
 {
-    const auto& rows = m_cannyEdges.rows;
-    const auto& cols = m_cannyEdges.cols;
+    const auto& rows = edges.rows;
+    const auto& cols = edges.cols;
 
     // Initialize matrices for strong and weak edges using OpenCV matrices for better performance
-    cv::Mat strongEdges = cv::Mat::zeros(rows, cols, CV_32F);
-    cv::Mat weakEdges = cv::Mat::zeros(rows, cols, CV_32F);
+    cv::Mat strongEdges = scratch != nullptr ? scratch->view(ScratchPlane::Strong, edges.size(), CV_32F)
+                                             : PlaneAllocator::instance()->plane(edges.size(), CV_32F);
+    cv::Mat weakEdges = scratch != nullptr ? scratch->view(ScratchPlane::Weak, edges.size(), CV_32F)
+                                           : PlaneAllocator::instance()->plane(edges.size(), CV_32F);
+    strongEdges.setTo(0);
+    weakEdges.setTo(0);
 
     // Identify strong and weak edges
     for (int row = 0; row < rows; ++row)
     {
         for (int col = 0; col < cols; ++col)
         {
-            float pixelValue = m_cannyEdges.at<uint8_t>(row, col);
-            strongEdges.at<bool>(row, col) = (pixelValue >= m_highThreshold);
-            weakEdges.at<bool>(row, col) = (pixelValue >= m_lowThreshold);
+            float pixelValue = edges.at<uint8_t>(row, col);
+            strongEdges.at<bool>(row, col) = (pixelValue >= highThreshold);
+            weakEdges.at<bool>(row, col) = (pixelValue >= lowThreshold);
         }
     }
 
@@ -291,32 +332,257 @@ void EdgeDetection::applyLinkingAndHysteresis()
                 continue;
             }
 
-            checkContours(strongEdges, weakEdges, row, col, row, col);
+            checkContours(edges, strongEdges, weakEdges, row, col, row, col);
         }
     }
-    // m_imageFileOperations->saveImage("canny.png", m_cannyEdges);// change here
-    m_imageFileOperations->saveImage("../imgtrial/canny.png", m_cannyEdges);
+}
+
+void EdgeDetection::setGeoTiffOptions(const GeoTiffOptions& options)
+{
+    m_geoTiffOptions = options;
+}
+
+void EdgeDetection::saveEdges(const std::string& inputImage, const std::string& outputImage)
+{
+    const auto extension = std::filesystem::path(outputImage).extension();
+    if (extension != ".tif" && extension != ".tiff")
+    {
+        m_imageFileOperations->saveImage(outputImage, m_cannyEdges);
+        return;
+    }
+
+    GeoTiffWriter writer(outputImage, m_cannyEdges.cols, m_cannyEdges.rows, m_cannyEdges.type(), m_geoTiffOptions);
+    try
+    {
+        SatelliteImageWrapper source(inputImage);
+        writer.copyGeoreference(source);
+    }
+    catch (const std::runtime_error& e)
+    {
+        std::cerr << "Writing " << outputImage << " without georeferencing: " << e.what() << std::endl;
+    }
+    writer.write(m_cannyEdges);
 }
 
 void EdgeDetection::cannyEdgeDetection(const std::string& inputImage, const std::string& outputImage)
 {
-    m_imageFileOperations = std::make_shared<ImageFileOperations>();
+    const std::string key = ImageFileOperations::imageKey(inputImage);
+    if (!key.empty() && key == m_preparedKey && m_sigma == m_preparedSigma)
+    {
+        applyThresholds();
+        saveEdges(inputImage, outputImage);
+        return;
+    }
 
-    m_originalImage = m_imageFileOperations->loadImage(inputImage);
-    if (m_originalImage.empty())
+    std::shared_ptr<MappedImage> mappedImage;
+    cv::Mat image;
+    if (m_mappedInput)
+    {
+        try
+        {
+            mappedImage = m_imageFileOperations->mapImage(inputImage);
+            image = mappedImage->view();
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Decoding " << inputImage << " instead of mapping it: " << e.what() << std::endl;
+        }
+    }
+    if (image.empty())
+    {
+        image = m_imageFileOperations->loadImage(inputImage);
+    }
+    if (image.empty())
     {
         throw std::runtime_error("Failed to load image: " + inputImage);
     }
-    m_cannyEdges = cv::Mat(m_originalImage.size(), m_originalImage.type());
-    m_magnitude = cv::Mat(m_originalImage.size(), CV_32F);
-    m_direction = cv::Mat(m_originalImage.size(), CV_32F);
+
+    prepare(image);
+    m_preparedKey = key;
+    applyThresholds();
+
+    saveEdges(inputImage, outputImage);
+}
+
+const cv::Mat& EdgeDetection::detectEdges(const cv::Mat& inputImage)
+{
+    prepare(inputImage);
+    return applyThresholds();
+}
+
+PreparedImage EdgeDetection::prepareImage(const cv::Mat& inputImage)
+{
+    prepare(inputImage);
+
+    // Hand the plane over instead of copying it, the next detection allocates a new one
+    PreparedImage prepared(m_suppressed, m_magnitudeHistogram);
+    m_suppressed.release();
+    return prepared;
+}
+
+void EdgeDetection::prepare(const cv::Mat& inputImage)
+{
+    if (inputImage.type() != CV_8UC1)
+    {
+        throw std::runtime_error("Canny edge detection expects an 8-bit single channel image");
+    }
+
+    m_preparedKey.clear();
+    m_originalImage = inputImage;
+    reallocatePlane(m_cannyEdges, m_originalImage.size(), m_originalImage.type());
+    m_magnitude = m_scratch.view(ScratchPlane::Magnitude, m_originalImage.size(), CV_32F);
+    m_direction = m_scratch.view(ScratchPlane::Direction, m_originalImage.size(), CV_32F);
 
     // Apply Gaussian blur
     applyGaussianBlur();
+    reportProgress(PROGRESS_BLUR);
 
     sobelOperator();
+    reportProgress(PROGRESS_SOBEL);
 
     nonMaximumSuppression();
+    reportProgress(PROGRESS_SUPPRESSION);
+
+    // Keep the suppressed plane, the hysteresis overwrites the edges in place
+    m_suppressed.allocator = PlaneAllocator::instance();
+    m_cannyEdges.copyTo(m_suppressed);
+    m_preparedSigma = m_sigma;
+
+    // Do not keep the input alive, it may point into a mapping owned by the caller
+    m_originalImage.release();
+}
 
-    applyLinkingAndHysteresis();
+const cv::Mat& EdgeDetection::applyThresholds()
+{
+    if (m_thresholdMode != ThresholdMode::Fixed)
+    {
+        const Thresholds chosen = m_thresholdMode == ThresholdMode::Otsu
+                                      ? otsuThresholds(m_magnitudeHistogram)
+                                      : percentileThresholds(m_magnitudeHistogram, m_percentile);
+        setThresholds(chosen.low, chosen.high);
+    }
+    m_suppressed.copyTo(m_cannyEdges);
+    applyLinkingAndHysteresis(m_cannyEdges, m_lowThreshold, m_highThreshold, &m_scratch);
+    reportProgress(PROGRESS_DONE);
+    return m_cannyEdges;
+}
+
+void EdgeDetection::setThresholds(float lowThreshold, float highThreshold)
+{
+    m_lowThreshold = lowThreshold;
+    m_highThreshold = highThreshold;
+}
+
+void EdgeDetection::setThresholdMode(ThresholdMode mode, double percentile)
+{
+    m_thresholdMode = mode;
+    m_percentile = percentile;
+}
+
+Thresholds EdgeDetection::thresholds() const
+{
+    return {m_lowThreshold, m_highThreshold};
+}
+
+void EdgeDetection::setSigma(float sigma)
+{
+    m_sigma = sigma;
+}
+
+void EdgeDetection::setMappedInput(bool enabled)
+{
+    m_mappedInput = enabled;
+}
+
+std::vector<RoiEdges> EdgeDetection::detectEdges(const cv::Mat& inputImage, const std::vector<cv::Rect>& rois)
+{
+    const cv::Rect frame(0, 0, inputImage.cols, inputImage.rows);
+    std::vector<RoiEdges> results;
+    results.reserve(rois.size());
+    for (const auto& roi : rois)
+    {
+        const cv::Rect clipped = roi & frame;
+        const cv::Rect halo = haloRect(clipped, frame);
+        results.push_back(detectRoiEdges(clipped.empty() ? cv::Mat() : inputImage(halo), clipped, halo));
+        reportProgress(static_cast<int>(PROGRESS_DONE * results.size() / rois.size()));
+    }
+    return results;
+}
+
+std::vector<RoiEdges> EdgeDetection::detectEdges(SatelliteImageWrapper& image, int bandNumber,
+                                                 const std::vector<cv::Rect>& rois)
+{
+    const cv::Rect frame(cv::Point(0, 0), image.bandSize(bandNumber));
+    std::vector<RoiEdges> results;
+    results.reserve(rois.size());
+    for (const auto& roi : rois)
+    {
+        const cv::Rect clipped = roi & frame;
+        const cv::Rect halo = haloRect(clipped, frame);
+        cv::Mat window = clipped.empty() ? cv::Mat() : image.readWindow(bandNumber, halo);
+        results.push_back(detectRoiEdges(window, clipped, halo));
+        reportProgress(static_cast<int>(PROGRESS_DONE * results.size() / rois.size()));
+    }
+    return results;
+}
+
+RoiEdges EdgeDetection::detectRoiEdges(const cv::Mat& window, const cv::Rect& roi, const cv::Rect& halo)
+{
+    if (roi.empty())
+    {
+        return {roi, cv::Mat(), 0};
+    }
+
+    // The stages of every window would overwrite each other, so they are never written here, the progress is
+    // reported per window by the caller and the thresholds of the frame are kept
+    const bool saveStages = m_saveStages;
+    const ThresholdMode thresholdMode = m_thresholdMode;
+    std::function<void(int)> progress = std::move(m_progress);
+    m_saveStages = false;
+    m_thresholdMode = ThresholdMode::Fixed;
+    m_progress = nullptr;
+    try
+    {
+        detectEdges(window);
+    }
+    catch (...)
+    {
+        m_saveStages = saveStages;
+        m_thresholdMode = thresholdMode;
+        m_progress = std::move(progress);
+        throw;
+    }
+    m_saveStages = saveStages;
+    m_thresholdMode = thresholdMode;
+    m_progress = std::move(progress);
+
+    cv::Mat roiEdges = m_cannyEdges(cv::Rect(roi.tl() - halo.tl(), roi.size())).clone();
+    const auto edgePixels = static_cast<std::size_t>(cv::countNonZero(roiEdges));
+    return {roi, roiEdges, edgePixels};
+}
+
+void EdgeDetection::setSaveStages(bool enabled)
+{
+    m_saveStages = enabled;
+}
+
+void EdgeDetection::setProgressCallback(std::function<void(int)> callback)
+{
+    m_progress = std::move(callback);
+}
+
+void EdgeDetection::reportProgress(int percent)
+{
+    if (m_progress)
+    {
+        m_progress(percent);
+    }
+}
+
+void EdgeDetection::saveStage(const std::string& filename, const cv::Mat& image)
+{
+    if (m_saveStages)
+    {
+        m_imageFileOperations->saveImage(filename, image);
+    }
 }
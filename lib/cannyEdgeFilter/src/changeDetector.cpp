@@ -0,0 +1,128 @@
+/*
+ * LuckyAlgorithmForSatellites - changeDetector
+ * Copyright (C) 2024, Operating Systems II.
+ * Apr 24, 2024.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ */
+
+#include "changeDetector.hpp"
+#include <cstdint>
+#include <cstdlib>
+
+ChangeDetector::ChangeDetector(int tileSize, double threshold)
+    : m_tileSize(tileSize)
+    , m_threshold(threshold)
+{
+}
+
+void ChangeDetector::compareTiles(const cv::Mat& frame)
+{
+    const cv::Rect frameRect(0, 0, frame.cols, frame.rows);
+    const int tileRows = m_result.tileMask.rows;
+    const int tileCols = m_result.tileMask.cols;
+
+#pragma omp parallel for collapse(2) schedule(dynamic)
+    for (int tileRow = 0; tileRow < tileRows; ++tileRow)
+    {
+        for (int tileCol = 0; tileCol < tileCols; ++tileCol)
+        {
+            const cv::Rect tile =
+                cv::Rect(tileCol * m_tileSize, tileRow * m_tileSize, m_tileSize, m_tileSize) & frameRect;
+            std::uint64_t sad = 0;
+            for (int row = tile.y; row < tile.y + tile.height; ++row)
+            {
+                const uchar* current = frame.ptr<uchar>(row) + tile.x;
+                const uchar* reference = m_reference.ptr<uchar>(row) + tile.x;
+                unsigned int rowSad = 0;
+#pragma omp simd reduction(+ : rowSad)
+                for (int col = 0; col < tile.width; ++col)
+                {
+                    rowSad += std::abs(static_cast<int>(current[col]) - static_cast<int>(reference[col]));
+                }
+                sad += rowSad;
+            }
+            m_result.tileMask.at<uchar>(tileRow, tileCol) = (sad > m_threshold * tile.area()) ? 255 : 0;
+        }
+    }
+}
+
+const ChangeDetectionResult& ChangeDetector::process(EdgeDetection& edgeDetection, const cv::Mat& frame)
+{
+    if (frame.type() != CV_8UC1)
+    {
+        throw std::runtime_error("Change detection expects an 8-bit single channel frame");
+    }
+
+    const cv::Rect frameRect(0, 0, frame.cols, frame.rows);
+    const int tileRows = (frame.rows + m_tileSize - 1) / m_tileSize;
+    const int tileCols = (frame.cols + m_tileSize - 1) / m_tileSize;
+    m_result.changed.clear();
+
+    if (m_reference.empty() || m_reference.size() != frame.size())
+    {
+        m_result.edges = edgeDetection.detectEdges(frame).clone();
+        m_result.tileMask = cv::Mat(tileRows, tileCols, CV_8UC1, cv::Scalar(255));
+        m_result.changed.push_back(frameRect);
+        m_result.fullRecompute = true;
+        m_reference = frame.clone();
+        return m_result;
+    }
+
+    m_result.tileMask.create(tileRows, tileCols, CV_8UC1);
+    compareTiles(frame);
+
+    // Merge horizontal runs of changed tiles, so neighbouring tiles share a single halo
+    for (int tileRow = 0; tileRow < tileRows; ++tileRow)
+    {
+        int tileCol = 0;
+        while (tileCol < tileCols)
+        {
+            if (!m_result.tileMask.at<uchar>(tileRow, tileCol))
+            {
+                ++tileCol;
+                continue;
+            }
+            const int firstCol = tileCol;
+            while (tileCol < tileCols && m_result.tileMask.at<uchar>(tileRow, tileCol))
+            {
+                ++tileCol;
+            }
+            m_result.changed.push_back(cv::Rect(firstCol * m_tileSize, tileRow * m_tileSize,
+                                                (tileCol - firstCol) * m_tileSize, m_tileSize) &
+                                       frameRect);
+        }
+    }
+    m_result.fullRecompute = false;
+
+    // A change reaches the edges up to ROI_HALO pixels away, so the unchanged tiles around a run are recomputed up to
+    // that distance too. The reference only takes the pixels of the changed tiles.
+    std::vector<cv::Rect> affected;
+    affected.reserve(m_result.changed.size());
+    for (const auto& run : m_result.changed)
+    {
+        affected.push_back(
+            cv::Rect(run.x - ROI_HALO, run.y - ROI_HALO, run.width + 2 * ROI_HALO, run.height + 2 * ROI_HALO) &
+            frameRect);
+        frame(run).copyTo(m_reference(run));
+    }
+    for (const auto& roiEdges : edgeDetection.detectEdges(frame, affected))
+    {
+        roiEdges.edges.copyTo(m_result.edges(roiEdges.roi));
+    }
+
+    return m_result;
+}
+
+void ChangeDetector::reset()
+{
+    m_reference.release();
+}
@@ -0,0 +1,212 @@
+/*
+ * LuckyAlgorithmForSatellites - edgeSegments
+ * Copyright (C) 2024, Operating Systems II.
+ * Apr 24, 2024.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ */
+
+#include "edgeSegments.hpp"
+#include <algorithm>
+#include <numeric>
+#include <opencv2/imgproc.hpp>
+#include <stdexcept>
+
+namespace
+{
+/**
+ * @brief Disjoint sets over the components of every tile.
+ */
+class UnionFind
+{
+public:
+    explicit UnionFind(int size)
+        : m_parent(size)
+    {
+        std::iota(m_parent.begin(), m_parent.end(), 0);
+    }
+
+    int find(int node)
+    {
+        while (m_parent[node] != node)
+        {
+            m_parent[node] = m_parent[m_parent[node]];
+            node = m_parent[node];
+        }
+        return node;
+    }
+
+    void unite(int first, int second)
+    {
+        first = find(first);
+        second = find(second);
+        // The smaller index wins, which keeps the segments in the order of their first component
+        if (first < second)
+        {
+            m_parent[second] = first;
+        }
+        else if (second < first)
+        {
+            m_parent[first] = second;
+        }
+    }
+
+private:
+    std::vector<int> m_parent; ///< Parent of each component, the roots are their own parent.
+};
+} // namespace
+
+std::vector<EdgeSegment> extractEdgeSegments(const cv::Mat& edges, double epsilon, int tileSize)
+{
+    if (edges.type() != CV_8UC1)
+    {
+        throw std::runtime_error("Edge segments expect an 8-bit single channel edge map");
+    }
+    if (tileSize <= 0)
+    {
+        throw std::runtime_error("The segment tile size must be positive");
+    }
+
+    const int tileCols = (edges.cols + tileSize - 1) / tileSize;
+    const int tileRows = (edges.rows + tileSize - 1) / tileSize;
+    const int tiles = tileCols * tileRows;
+    auto tileRect = [&](int tile) {
+        const int x = (tile % tileCols) * tileSize;
+        const int y = (tile / tileCols) * tileSize;
+        return cv::Rect(x, y, std::min(tileSize, edges.cols - x), std::min(tileSize, edges.rows - y));
+    };
+
+    // Every tile is labelled on its own, label 0 is the background
+    cv::Mat labels(edges.size(), CV_32S);
+    std::vector<cv::Mat> stats(tiles);
+#pragma omp parallel for schedule(dynamic)
+    for (int tile = 0; tile < tiles; ++tile)
+    {
+        cv::Mat tileLabels = labels(tileRect(tile));
+        cv::Mat centroids;
+        cv::connectedComponentsWithStats(edges(tileRect(tile)), tileLabels, stats[tile], centroids, 8, CV_32S);
+    }
+
+    // Component c of a tile becomes the global component first[tile] + c - 1
+    std::vector<int> first(tiles + 1, 0);
+    for (int tile = 0; tile < tiles; ++tile)
+    {
+        first[tile + 1] = first[tile] + stats[tile].rows - 1;
+    }
+    auto component = [&](int row, int col) {
+        const int tile = (row / tileSize) * tileCols + col / tileSize;
+        return first[tile] + labels.at<int>(row, col) - 1;
+    };
+
+    // Stitch the components touching across the tile boundaries, diagonals included
+    UnionFind sets(first[tiles]);
+    for (int col = tileSize; col < edges.cols; col += tileSize)
+    {
+        for (int row = 0; row < edges.rows; ++row)
+        {
+            if (labels.at<int>(row, col - 1) == 0)
+            {
+                continue;
+            }
+            for (int neighbour = std::max(0, row - 1); neighbour <= std::min(edges.rows - 1, row + 1); ++neighbour)
+            {
+                if (labels.at<int>(neighbour, col) != 0)
+                {
+                    sets.unite(component(row, col - 1), component(neighbour, col));
+                }
+            }
+        }
+    }
+    for (int row = tileSize; row < edges.rows; row += tileSize)
+    {
+        for (int col = 0; col < edges.cols; ++col)
+        {
+            if (labels.at<int>(row - 1, col) == 0)
+            {
+                continue;
+            }
+            for (int neighbour = std::max(0, col - 1); neighbour <= std::min(edges.cols - 1, col + 1); ++neighbour)
+            {
+                if (labels.at<int>(row, neighbour) != 0)
+                {
+                    sets.unite(component(row - 1, col), component(row, neighbour));
+                }
+            }
+        }
+    }
+
+    // Number the segments and merge the statistics of their components
+    std::vector<int> segmentOf(first[tiles]);
+    std::vector<EdgeSegment> segments;
+    for (int tile = 0; tile < tiles; ++tile)
+    {
+        const cv::Point origin = tileRect(tile).tl();
+        for (int label = 1; label < stats[tile].rows; ++label)
+        {
+            const int index = first[tile] + label - 1;
+            const int root = sets.find(index);
+            const cv::Rect bounds(stats[tile].at<int>(label, cv::CC_STAT_LEFT) + origin.x,
+                                  stats[tile].at<int>(label, cv::CC_STAT_TOP) + origin.y,
+                                  stats[tile].at<int>(label, cv::CC_STAT_WIDTH),
+                                  stats[tile].at<int>(label, cv::CC_STAT_HEIGHT));
+            const auto pixels = static_cast<std::size_t>(stats[tile].at<int>(label, cv::CC_STAT_AREA));
+            if (root == index)
+            {
+                segmentOf[index] = static_cast<int>(segments.size());
+                segments.push_back({bounds, pixels, 0.0, {}});
+            }
+            else
+            {
+                segmentOf[index] = segmentOf[root];
+                segments[segmentOf[index]].bounds |= bounds;
+                segments[segmentOf[index]].pixels += pixels;
+            }
+        }
+    }
+
+    // Relabel the map with the segments, 1-based so the background stays 0
+#pragma omp parallel for schedule(dynamic)
+    for (int tile = 0; tile < tiles; ++tile)
+    {
+        cv::Mat tileLabels = labels(tileRect(tile));
+        for (int row = 0; row < tileLabels.rows; ++row)
+        {
+            int* label = tileLabels.ptr<int>(row);
+            for (int col = 0; col < tileLabels.cols; ++col)
+            {
+                if (label[col] != 0)
+                {
+                    label[col] = segmentOf[first[tile] + label[col] - 1] + 1;
+                }
+            }
+        }
+    }
+
+    const int count = static_cast<int>(segments.size());
+#pragma omp parallel for schedule(dynamic)
+    for (int index = 0; index < count; ++index)
+    {
+        EdgeSegment& segment = segments[index];
+        cv::Mat mask = labels(segment.bounds) == index + 1;
+        std::vector<std::vector<cv::Point>> outlines;
+        cv::findContours(mask, outlines, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_NONE, segment.bounds.tl());
+        if (outlines.empty())
+        {
+            continue;
+        }
+        // The pixels are 8-connected, so there is a single outer outline
+        const auto& outline = *std::max_element(outlines.begin(), outlines.end(),
+                                                [](const auto& a, const auto& b) { return a.size() < b.size(); });
+        segment.length = cv::arcLength(outline, true) / 2;
+        cv::approxPolyDP(outline, segment.polyline, epsilon, true);
+    }
+    return segments;
+}
@@ -0,0 +1,169 @@
+/*
+ * LuckyAlgorithmForSatellites - geoTiffWriter
+ * Copyright (C) 2024, Operating Systems II.
+ * Apr 24, 2024.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ */
+
+#include "geoTiffWriter.hpp"
+#include "satelliteImageWrapper.hpp"
+#include <gdal_priv.h>
+
+namespace
+{
+GDALDataType toGdalType(int depth)
+{
+    switch (depth)
+    {
+    case CV_8U:
+        return GDT_Byte;
+    case CV_16U:
+        return GDT_UInt16;
+    case CV_16S:
+        return GDT_Int16;
+    case CV_32S:
+        return GDT_Int32;
+    case CV_32F:
+        return GDT_Float32;
+    case CV_64F:
+        return GDT_Float64;
+    default:
+        throw std::runtime_error("Unsupported image depth for GeoTIFF: " + std::to_string(depth));
+    }
+}
+
+const char* compressionName(GeoTiffCompression compression)
+{
+    switch (compression)
+    {
+    case GeoTiffCompression::Deflate:
+        return "DEFLATE";
+    case GeoTiffCompression::Lzw:
+        return "LZW";
+    case GeoTiffCompression::Zstd:
+        return "ZSTD";
+    default:
+        return "NONE";
+    }
+}
+} // namespace
+
+GeoTiffWriter::GeoTiffWriter(const std::string& filename, int cols, int rows, int type, const GeoTiffOptions& options)
+    : m_dataset(nullptr)
+    , m_type(type)
+{
+    GDALAllRegister();
+    GDALDriver* driver = GetGDALDriverManager()->GetDriverByName("GTiff");
+    if (!driver)
+    {
+        throw std::runtime_error("GTiff driver is not available");
+    }
+
+    const std::string tileSize = std::to_string(options.tileSize);
+    const std::string threads = options.threads > 0 ? std::to_string(options.threads) : "ALL_CPUS";
+
+    char** creationOptions = nullptr;
+    creationOptions = CSLSetNameValue(creationOptions, "TILED", "YES");
+    creationOptions = CSLSetNameValue(creationOptions, "BLOCKXSIZE", tileSize.c_str());
+    creationOptions = CSLSetNameValue(creationOptions, "BLOCKYSIZE", tileSize.c_str());
+    creationOptions = CSLSetNameValue(creationOptions, "BIGTIFF", "IF_SAFER");
+    creationOptions = CSLSetNameValue(creationOptions, "COMPRESS", compressionName(options.compression));
+    if (options.compression != GeoTiffCompression::None)
+    {
+        creationOptions = CSLSetNameValue(creationOptions, "NUM_THREADS", threads.c_str());
+        creationOptions =
+            CSLSetNameValue(creationOptions, "PREDICTOR", std::to_string(static_cast<int>(options.predictor)).c_str());
+        if (options.level >= 0 && options.compression != GeoTiffCompression::Lzw)
+        {
+            creationOptions =
+                CSLSetNameValue(creationOptions, options.compression == GeoTiffCompression::Zstd ? "ZSTD_LEVEL" : "ZLEVEL",
+                                std::to_string(options.level).c_str());
+        }
+    }
+
+    m_dataset = driver->Create(
+        filename.c_str(), cols, rows, CV_MAT_CN(type), toGdalType(CV_MAT_DEPTH(type)), creationOptions);
+    CSLDestroy(creationOptions);
+    if (!m_dataset)
+    {
+        throw std::runtime_error("Failed to create GeoTIFF file: " + filename);
+    }
+}
+
+GeoTiffWriter::~GeoTiffWriter()
+{
+    GDALClose(m_dataset);
+}
+
+bool GeoTiffWriter::copyGeoreference(const SatelliteImageWrapper& source)
+{
+    std::array<double, 6> geoTransform;
+    if (!source.getGeoTransform(geoTransform))
+    {
+        return false;
+    }
+    setGeoTransform(geoTransform);
+    setProjection(source.getProjection());
+    return true;
+}
+
+void GeoTiffWriter::setGeoTransform(const std::array<double, 6>& geoTransform)
+{
+    std::array<double, 6> coefficients = geoTransform;
+    if (m_dataset->SetGeoTransform(coefficients.data()) != CE_None)
+    {
+        throw std::runtime_error("Failed to set the GeoTIFF geotransform");
+    }
+}
+
+void GeoTiffWriter::setProjection(const std::string& projection)
+{
+    if (!projection.empty() && m_dataset->SetProjection(projection.c_str()) != CE_None)
+    {
+        throw std::runtime_error("Failed to set the GeoTIFF projection");
+    }
+}
+
+void GeoTiffWriter::writeBlock(int xOffset, int yOffset, const cv::Mat& block)
+{
+    if (block.type() != m_type)
+    {
+        throw std::runtime_error("Block type does not match the GeoTIFF type");
+    }
+
+    const GDALDataType gdalType = toGdalType(block.depth());
+    const GSpacing pixelSpace = static_cast<GSpacing>(block.elemSize());
+    const GSpacing lineSpace = static_cast<GSpacing>(block.step[0]);
+
+    // Channels are interleaved in OpenCV, so each band starts one sample further and skips the others.
+    for (int channel = 0; channel < block.channels(); ++channel)
+    {
+        auto band = m_dataset->GetRasterBand(channel + 1);
+        auto data = const_cast<uchar*>(block.data) + channel * block.elemSize1();
+        if (band->RasterIO(GF_Write, xOffset, yOffset, block.cols, block.rows, data, block.cols, block.rows, gdalType,
+                           pixelSpace, lineSpace) != CE_None)
+        {
+            throw std::runtime_error("Failed to write GeoTIFF block at " + std::to_string(xOffset) + "," +
+                                     std::to_string(yOffset));
+        }
+    }
+}
+
+void GeoTiffWriter::write(const cv::Mat& image)
+{
+    writeBlock(0, 0, image);
+}
+
+void GeoTiffWriter::flush()
+{
+    m_dataset->FlushCache();
+}
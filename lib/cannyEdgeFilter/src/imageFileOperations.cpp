@@ -15,6 +15,130 @@
  */
 
 #include "imageFileOperations.hpp"
+#include "lruCache.hpp"
+#include "satelliteImageWrapper.hpp"
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sys/stat.h>
+
+namespace
+{
+LruCache<std::string, cv::Mat>& decodedImages()
+{
+    static LruCache<std::string, cv::Mat> cache(DECODED_CACHE_BUDGET);
+    return cache;
+}
+
+/**
+ * @brief Finds the ENVI header of a raw raster, either "image.hdr" or "image.bin.hdr".
+ */
+std::string enviHeaderPath(const std::string& filename)
+{
+    std::filesystem::path replaced(filename);
+    replaced.replace_extension(".hdr");
+    for (const auto& candidate : {replaced.string(), filename + ".hdr"})
+    {
+        if (candidate != filename && std::filesystem::exists(candidate))
+        {
+            return candidate;
+        }
+    }
+    return "";
+}
+
+int enviDepth(int dataType)
+{
+    switch (dataType)
+    {
+    case 1:
+        return CV_8U;
+    case 2:
+        return CV_16S;
+    case 3:
+        return CV_32S;
+    case 4:
+        return CV_32F;
+    case 5:
+        return CV_64F;
+    case 12:
+        return CV_16U;
+    default:
+        throw std::runtime_error("Unsupported ENVI data type: " + std::to_string(dataType));
+    }
+}
+
+std::shared_ptr<MappedImage> mapEnviImage(const std::string& filename, const std::string& headerPath)
+{
+    std::ifstream header(headerPath);
+    std::map<std::string, std::string> fields;
+    auto trim = [](std::string text) {
+        text.erase(0, text.find_first_not_of(" \t\r"));
+        text.erase(text.find_last_not_of(" \t\r") + 1);
+        std::transform(text.begin(), text.end(), text.begin(), ::tolower);
+        return text;
+    };
+    std::string line;
+    while (std::getline(header, line))
+    {
+        auto separator = line.find('=');
+        if (separator == std::string::npos)
+        {
+            continue;
+        }
+        fields[trim(line.substr(0, separator))] = trim(line.substr(separator + 1));
+    }
+
+    auto field = [&](const std::string& key, const std::string& fallback) {
+        auto it = fields.find(key);
+        if (it == fields.end())
+        {
+            if (fallback.empty())
+            {
+                throw std::runtime_error("Missing \"" + key + "\" in ENVI header: " + headerPath);
+            }
+            return fallback;
+        }
+        return it->second;
+    };
+
+    const int cols = std::stoi(field("samples", ""));
+    const int rows = std::stoi(field("lines", ""));
+    const int bands = std::stoi(field("bands", "1"));
+    const std::size_t offset = std::stoull(field("header offset", "0"));
+    const int depth = enviDepth(std::stoi(field("data type", "")));
+    const std::string interleave = field("interleave", "bsq");
+    const bool bigEndian = field("byte order", "0") == "1";
+    if (CV_ELEM_SIZE1(depth) > 1 && bigEndian != (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__))
+    {
+        throw std::runtime_error("ENVI byte order does not match the host: " + headerPath);
+    }
+
+    if (depth != CV_8U)
+    {
+        throw std::runtime_error("Only 8-bit ENVI rasters can be mapped: " + headerPath);
+    }
+    if (bands < 1 || bands > CV_CN_MAX)
+    {
+        throw std::runtime_error("Invalid number of bands in ENVI header: " + headerPath);
+    }
+
+    const std::size_t rowBytes = static_cast<std::size_t>(cols) * CV_ELEM_SIZE1(depth);
+    if (interleave == "bip")
+    {
+        auto image = std::make_shared<MappedImage>(filename, offset, rows, cols, CV_MAKETYPE(depth, bands));
+        image->selectChannel(0);
+        return image;
+    }
+    if (interleave == "bil")
+    {
+        return std::make_shared<MappedImage>(filename, offset, rows, cols, depth, rowBytes * bands);
+    }
+    return std::make_shared<MappedImage>(filename, offset, rows, cols, depth, rowBytes);
+}
+} // namespace
 
 bool ImageFileOperations::saveImage(const std::string& filename, const cv::Mat& image)
 {
@@ -22,6 +146,51 @@ bool ImageFileOperations::saveImage(const std::string& filename, const cv::Mat&
 }
 
 cv::Mat ImageFileOperations::loadImage(const std::string& filename)
+{
+    const std::string key = imageKey(filename);
+    if (!key.empty())
+    {
+        if (auto cached = decodedImages().get(key))
+        {
+            return *cached;
+        }
+    }
+
+    cv::Mat image = decodeImage(filename);
+    if (!key.empty() && !image.empty())
+    {
+        decodedImages().put(key, image, image.total() * image.elemSize());
+    }
+    return image;
+}
+
+cv::Mat ImageFileOperations::decodeImage(const std::string& filename)
 {
     return cv::imread(filename, cv::IMREAD_GRAYSCALE);
 }
+
+void ImageFileOperations::setCacheBudget(std::size_t bytes)
+{
+    decodedImages().setBudget(bytes);
+}
+
+std::string ImageFileOperations::imageKey(const std::string& filename)
+{
+    struct stat fileStat;
+    if (stat(filename.c_str(), &fileStat) < 0)
+    {
+        return "";
+    }
+    return filename + "|" + std::to_string(fileStat.st_mtim.tv_sec) + "." + std::to_string(fileStat.st_mtim.tv_nsec) +
+           "|" + std::to_string(fileStat.st_size);
+}
+
+std::shared_ptr<MappedImage> ImageFileOperations::mapImage(const std::string& filename)
+{
+    auto headerPath = enviHeaderPath(filename);
+    if (!headerPath.empty())
+    {
+        return mapEnviImage(filename, headerPath);
+    }
+    return SatelliteImageWrapper(filename).mapBand(1);
+}
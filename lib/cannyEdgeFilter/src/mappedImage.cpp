@@ -0,0 +1,97 @@
+/*
+ * LuckyAlgorithmForSatellites - mappedImage
+ * Copyright (C) 2024, Operating Systems II.
+ * Apr 24, 2024.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ */
+
+#include "mappedImage.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedImage::MappedImage(const std::string& filename, std::size_t offset, int rows, int cols, int type,
+                         std::size_t step)
+    : m_mapping(MAP_FAILED)
+    , m_length(0)
+{
+    if (rows <= 0 || cols <= 0)
+    {
+        throw std::runtime_error("Invalid raster size for file: " + filename);
+    }
+    if (step == 0)
+    {
+        step = static_cast<std::size_t>(cols) * CV_ELEM_SIZE(type);
+    }
+    const std::size_t imageBytes = step * (rows - 1) + static_cast<std::size_t>(cols) * CV_ELEM_SIZE(type);
+
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Failed to open file: " + filename);
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) < 0 || static_cast<std::size_t>(fileStat.st_size) < offset + imageBytes)
+    {
+        close(fd);
+        throw std::runtime_error("File is smaller than the raster it describes: " + filename);
+    }
+
+    // mmap offsets must be page aligned, so map from the page holding the first pixel
+    const auto pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    const std::size_t alignedOffset = offset - offset % pageSize;
+    m_length = imageBytes + (offset - alignedOffset);
+    m_mapping = mmap(nullptr, m_length, PROT_READ, MAP_PRIVATE, fd, static_cast<off_t>(alignedOffset));
+    close(fd);
+    if (m_mapping == MAP_FAILED)
+    {
+        throw std::runtime_error("Failed to map file: " + filename);
+    }
+
+    // The Canny stages walk the raster row by row, let the kernel read ahead aggressively
+    madvise(m_mapping, m_length, MADV_SEQUENTIAL);
+    madvise(m_mapping, m_length, MADV_WILLNEED);
+
+    auto firstPixel = static_cast<uchar*>(m_mapping) + (offset - alignedOffset);
+    m_view = cv::Mat(rows, cols, type, firstPixel, step);
+}
+
+MappedImage::~MappedImage()
+{
+    m_view.release();
+    if (m_mapping != MAP_FAILED)
+    {
+        munmap(m_mapping, m_length);
+    }
+}
+
+const cv::Mat& MappedImage::view() const
+{
+    return m_view;
+}
+
+void MappedImage::selectChannel(int channel)
+{
+    if (channel < 0 || channel >= m_view.channels())
+    {
+        throw std::runtime_error("Invalid channel of a mapped raster: " + std::to_string(channel));
+    }
+    if (m_view.channels() == 1)
+    {
+        return;
+    }
+    cv::Mat plane;
+    cv::extractChannel(m_view, plane, channel);
+    m_view = plane;
+}
@@ -0,0 +1,194 @@
+/*
+ * LuckyAlgorithmForSatellites - planeAllocator
+ * Copyright (C) 2024, Operating Systems II.
+ * Apr 24, 2024.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ */
+
+#include "planeAllocator.hpp"
+#include <cstdint>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace
+{
+std::size_t mappingSize(std::size_t bytes)
+{
+    return (bytes + PLANE_HUGE_PAGE - 1) / PLANE_HUGE_PAGE * PLANE_HUGE_PAGE;
+}
+} // namespace
+
+PlaneAllocator::PlaneAllocator(std::size_t budget, std::size_t minBytes)
+    : m_budget(budget)
+    , m_minBytes(minBytes)
+    , m_stats {0, 0, 0}
+{
+}
+
+PlaneAllocator::~PlaneAllocator()
+{
+    trim();
+}
+
+PlaneAllocator* PlaneAllocator::instance()
+{
+    // Never destroyed, planes held by static objects may be released after the end of main
+    static PlaneAllocator* allocator = new PlaneAllocator();
+    return allocator;
+}
+
+cv::Mat PlaneAllocator::plane(cv::Size size, int type)
+{
+    cv::Mat plane;
+    plane.allocator = this;
+    plane.create(size, type);
+    return plane;
+}
+
+void PlaneAllocator::trim()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& [bytes, mapping] : m_pool)
+    {
+        munmap(mapping, bytes);
+    }
+    m_pool.clear();
+    m_stats.pooledBytes = 0;
+}
+
+PlanePoolStats PlaneAllocator::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+cv::UMatData* PlaneAllocator::allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                                       cv::AccessFlag flags, cv::UMatUsageFlags usageFlags) const
+{
+    std::size_t total = CV_ELEM_SIZE(type);
+    for (int dim = dims - 1; dim >= 0; --dim)
+    {
+        total *= sizes[dim];
+    }
+    if (data != nullptr || total < m_minBytes)
+    {
+        return cv::Mat::getStdAllocator()->allocate(dims, sizes, type, data, step, flags, usageFlags);
+    }
+
+    // Packed rows, like the OpenCV allocator, so the planes stay continuous
+    std::size_t bytes = CV_ELEM_SIZE(type);
+    for (int dim = dims - 1; dim >= 0; --dim)
+    {
+        if (step != nullptr)
+        {
+            step[dim] = bytes;
+        }
+        bytes *= sizes[dim];
+    }
+
+    const std::size_t length = mappingSize(total);
+    void* mapping = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto pooled = m_pool.find(length);
+        if (pooled != m_pool.end())
+        {
+            mapping = pooled->second;
+            m_pool.erase(pooled);
+            m_stats.pooledBytes -= length;
+            ++m_stats.reused;
+        }
+    }
+    if (mapping == nullptr)
+    {
+        mapping = map(length);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_stats.mapped;
+    }
+
+    auto* matData = new cv::UMatData(this);
+    matData->data = matData->origdata = static_cast<uchar*>(mapping);
+    matData->size = total;
+    return matData;
+}
+
+bool PlaneAllocator::allocate(cv::UMatData* data, cv::AccessFlag, cv::UMatUsageFlags) const
+{
+    return data != nullptr;
+}
+
+void PlaneAllocator::deallocate(cv::UMatData* data) const
+{
+    if (data == nullptr)
+    {
+        return;
+    }
+    CV_Assert(data->urefcount == 0 && data->refcount == 0);
+
+    const std::size_t length = mappingSize(data->size);
+    bool pooled = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_stats.pooledBytes + length <= m_budget)
+        {
+            m_pool.emplace(length, data->origdata);
+            m_stats.pooledBytes += length;
+            pooled = true;
+        }
+    }
+    if (!pooled)
+    {
+        munmap(data->origdata, length);
+    }
+    delete data;
+}
+
+void* PlaneAllocator::map(std::size_t bytes)
+{
+    void* mapping = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    // Explicit huge pages only exist when the administrator reserved some, fall back silently otherwise
+    mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (mapping == MAP_FAILED)
+    {
+        // Over-map by a huge page and cut both ends, transparent huge pages need an aligned range
+        void* raw = mmap(nullptr, bytes + PLANE_HUGE_PAGE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED)
+        {
+            throw std::runtime_error("Failed to map a plane of " + std::to_string(bytes) + " bytes");
+        }
+        const auto address = reinterpret_cast<std::uintptr_t>(raw);
+        const std::uintptr_t aligned = (address + PLANE_HUGE_PAGE - 1) / PLANE_HUGE_PAGE * PLANE_HUGE_PAGE;
+        if (aligned > address)
+        {
+            munmap(raw, aligned - address);
+        }
+        munmap(reinterpret_cast<void*>(aligned + bytes), address + PLANE_HUGE_PAGE - aligned);
+        mapping = reinterpret_cast<void*>(aligned);
+#ifdef MADV_HUGEPAGE
+        madvise(mapping, bytes, MADV_HUGEPAGE);
+#endif
+    }
+
+    // First touch places each page on the NUMA node of the thread that will process its rows
+    auto* pages = static_cast<volatile char*>(mapping);
+    const auto pageSize = static_cast<std::int64_t>(sysconf(_SC_PAGESIZE));
+    const auto count = static_cast<std::int64_t>(bytes) / pageSize;
+#pragma omp parallel for schedule(static)
+    for (std::int64_t page = 0; page < count; ++page)
+    {
+        pages[page * pageSize] = 0;
+    }
+    return mapping;
+}
@@ -0,0 +1,56 @@
+/*
+ * LuckyAlgorithmForSatellites - preparedImage
+ * Copyright (C) 2024, Operating Systems II.
+ * Apr 24, 2024.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ */
+
+#include "preparedImage.hpp"
+#include "cannyEdgeFilter.hpp"
+#include <stdexcept>
+
+PreparedImage::PreparedImage(const cv::Mat& suppressed, const Histogram& magnitudeHistogram)
+    : m_suppressed(suppressed)
+    , m_histogram(magnitudeHistogram)
+{
+    if (m_suppressed.type() != CV_8UC1)
+    {
+        throw std::runtime_error("A prepared image expects an 8-bit single channel plane");
+    }
+}
+
+const cv::Mat& PreparedImage::suppressed() const
+{
+    return m_suppressed;
+}
+
+cv::Mat PreparedImage::threshold(float lowThreshold, float highThreshold) const
+{
+    cv::Mat edges = m_suppressed.clone();
+    EdgeDetection::applyLinkingAndHysteresis(edges, lowThreshold, highThreshold);
+    return edges;
+}
+
+cv::Mat PreparedImage::threshold(const Thresholds& thresholds) const
+{
+    return threshold(thresholds.low, thresholds.high);
+}
+
+Thresholds PreparedImage::otsuThresholds(double ratio) const
+{
+    return ::otsuThresholds(m_histogram, ratio);
+}
+
+Thresholds PreparedImage::medianThresholds(double sigma) const
+{
+    return ::medianThresholds(m_histogram, sigma);
+}
@@ -18,6 +18,7 @@
 
 // SatelliteImageWrapper methods
 SatelliteImageWrapper::SatelliteImageWrapper(const std::string& filename)
+    : m_filename(filename)
 {
     GDALAllRegister();
     m_dataset = (GDALDataset*)GDALOpen(filename.c_str(), GA_ReadOnly);
@@ -34,12 +35,15 @@ SatelliteImageWrapper::~SatelliteImageWrapper()
 
 cv::Mat SatelliteImageWrapper::readBand(int bandNumber)
 {
+    return readWindow(bandNumber, cv::Rect(cv::Point(0, 0), bandSize(bandNumber)));
+}
 
+cv::Mat SatelliteImageWrapper::readWindow(int bandNumber, const cv::Rect& window)
+{
     auto band = m_dataset->GetRasterBand(bandNumber);
-    int xSize = band->GetXSize();
-    int ySize = band->GetYSize();
-    cv::Mat image(ySize, xSize, CV_32FC1); // Float for GDAL compatibility
-    if (band->RasterIO(GF_Read, 0, 0, xSize, ySize, image.data, xSize, ySize, GDT_Float32, 0, 0) != CE_None)
+    cv::Mat image(window.height, window.width, CV_32FC1); // Float for GDAL compatibility
+    if (band->RasterIO(GF_Read, window.x, window.y, window.width, window.height, image.data, window.width,
+                       window.height, GDT_Float32, 0, 0) != CE_None)
     {
         throw std::runtime_error("Failed to read raster data from band: " + std::to_string(bandNumber));
     }
@@ -50,7 +54,71 @@ cv::Mat SatelliteImageWrapper::readBand(int bandNumber)
     return image;
 }
 
+cv::Size SatelliteImageWrapper::bandSize(int bandNumber) const
+{
+    auto band = m_dataset->GetRasterBand(bandNumber);
+    if (!band)
+    {
+        throw std::runtime_error("Invalid band number: " + std::to_string(bandNumber));
+    }
+    return cv::Size(band->GetXSize(), band->GetYSize());
+}
+
+std::shared_ptr<MappedImage> SatelliteImageWrapper::mapBand(int bandNumber)
+{
+    if (m_dataset->GetMetadataItem("COMPRESSION", "IMAGE_STRUCTURE") != nullptr)
+    {
+        throw std::runtime_error("Compressed rasters cannot be mapped: " + m_filename);
+    }
+    const char* interleave = m_dataset->GetMetadataItem("INTERLEAVE", "IMAGE_STRUCTURE");
+    if (m_dataset->GetRasterCount() > 1 && interleave && std::string(interleave) == "PIXEL")
+    {
+        throw std::runtime_error("Pixel interleaved rasters cannot be mapped as a single band: " + m_filename);
+    }
+
+    auto band = m_dataset->GetRasterBand(bandNumber);
+    if (!band || band->GetRasterDataType() != GDT_Byte)
+    {
+        throw std::runtime_error("Only 8-bit bands can be mapped: " + std::to_string(bandNumber));
+    }
+
+    int xSize = band->GetXSize();
+    int ySize = band->GetYSize();
+    int blockXSize = 0;
+    int blockYSize = 0;
+    band->GetBlockSize(&blockXSize, &blockYSize);
+
+    // Strips must span the whole width and follow each other in the file to form a single strided raster
+    const int lastStrip = (ySize + blockYSize - 1) / blockYSize - 1;
+    const char* firstOffset = band->GetMetadataItem("BLOCK_OFFSET_0_0", "TIFF");
+    const char* lastOffset = band->GetMetadataItem(("BLOCK_OFFSET_0_" + std::to_string(lastStrip)).c_str(), "TIFF");
+    if (blockXSize != xSize || !firstOffset || !lastOffset)
+    {
+        throw std::runtime_error("Only striped GeoTIFF rasters can be mapped: " + m_filename);
+    }
+
+    const std::size_t step = static_cast<std::size_t>(xSize);
+    const std::size_t offset = std::stoull(firstOffset);
+    if (std::stoull(lastOffset) != offset + static_cast<std::size_t>(lastStrip) * blockYSize * step)
+    {
+        throw std::runtime_error("Raster strips are not contiguous: " + m_filename);
+    }
+
+    return std::make_shared<MappedImage>(m_filename, offset, ySize, xSize, CV_8UC1, step);
+}
+
 bool SatelliteImageWrapper::isValid() const
 {
     return m_dataset != nullptr;
 }
+
+bool SatelliteImageWrapper::getGeoTransform(std::array<double, 6>& geoTransform) const
+{
+    return m_dataset->GetGeoTransform(geoTransform.data()) == CE_None;
+}
+
+std::string SatelliteImageWrapper::getProjection() const
+{
+    const char* projection = m_dataset->GetProjectionRef();
+    return projection ? projection : "";
+}
@@ -0,0 +1,65 @@
+/*
+ * LuckyAlgorithmForSatellites - scratchArena
+ * Copyright (C) 2024, Operating Systems II.
+ * Apr 24, 2024.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ */
+
+#include "scratchArena.hpp"
+#include "planeAllocator.hpp"
+#include <algorithm>
+
+ScratchArena::ScratchArena(const ScratchArena&)
+{
+}
+
+ScratchArena& ScratchArena::operator=(const ScratchArena& other)
+{
+    if (this != &other)
+    {
+        release();
+    }
+    return *this;
+}
+
+cv::Mat ScratchArena::view(ScratchPlane plane, cv::Size size, int type)
+{
+    cv::Mat& buffer = m_planes[static_cast<std::size_t>(plane)];
+    if (buffer.empty() || buffer.type() != type || buffer.cols < size.width || buffer.rows < size.height)
+    {
+        const cv::Size capacity = buffer.empty() || buffer.type() != type
+                                      ? size
+                                      : cv::Size(std::max(buffer.cols, size.width), std::max(buffer.rows, size.height));
+        // Release first, so the pool can hand the pages back if no view holds them
+        buffer.release();
+        buffer = PlaneAllocator::instance()->plane(capacity, type);
+    }
+    return buffer(cv::Rect(cv::Point(0, 0), size));
+}
+
+std::size_t ScratchArena::bytes() const
+{
+    std::size_t total = 0;
+    for (const cv::Mat& plane : m_planes)
+    {
+        total += plane.total() * plane.elemSize();
+    }
+    return total;
+}
+
+void ScratchArena::release()
+{
+    for (cv::Mat& plane : m_planes)
+    {
+        plane.release();
+    }
+}
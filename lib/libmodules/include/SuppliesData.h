@@ -75,6 +75,13 @@ class UserManager
      */
     void UpdateTokenSocket(const std::string &token, const int newSocket);
 
+    /**
+     * @brief Detaches a closed socket from the users bound to it.
+     *
+     * @param socket The closed socket. Its users get socket 0 again, as before their handshake.
+     */
+    void ReleaseSocket(const int socket);
+
     /**
      * @brief Checks if a user is authorized.
      *
@@ -41,6 +41,17 @@ void UserManager::UpdateTokenSocket(const std::string &token, const int newSocke
     }
 }
 
+void UserManager::ReleaseSocket(const int socket)
+{
+    for (auto &pair : users)
+    {
+        if (std::get<STATE2>(pair.second) == socket)
+        {
+            std::get<STATE2>(pair.second) = 0;
+        }
+    }
+}
+
 std::optional<bool> UserManager::IsUserAuthorized(const std::string &token)
 {
     if (users.find(token) != users.end())
@@ -17,6 +17,7 @@
 #ifndef _ROCKS_DB_WRAPPER_HPP
 #define _ROCKS_DB_WRAPPER_HPP
 
+#include <cstdint>
 #include <memory>
 #include <rocksdb/db.h>
 #include <string>
@@ -34,6 +35,13 @@ public:
      */
     explicit RocksDbWrapper(const std::string& pathDatabase);
 
+    /**
+     * @brief Constructor of a database bounded in size, meant for caches.
+     * @param pathDatabase Path to the database.
+     * @param maxBytes Size of the table files above which the oldest ones are dropped (FIFO compaction).
+     */
+    RocksDbWrapper(const std::string& pathDatabase, std::uint64_t maxBytes);
+
     /**
      * @brief Put a key-value pair in the database.
      * @param key Key to put.
@@ -62,6 +70,13 @@ public:
     void delete_(const std::string& key);
 
 private:
+    /**
+     * @brief Open or create the database.
+     * @param options Options of the database.
+     * @param pathDatabase Path to the database.
+     */
+    void open(const rocksdb::Options& options, const std::string& pathDatabase);
+
     std::shared_ptr<rocksdb::DB> m_database; ///< Database instance.
 };
 
@@ -20,6 +20,20 @@ RocksDbWrapper::RocksDbWrapper(const std::string& pathDatabase)
 {
     rocksdb::Options options;
     options.create_if_missing = true;
+    open(options, pathDatabase);
+}
+
+RocksDbWrapper::RocksDbWrapper(const std::string& pathDatabase, std::uint64_t maxBytes)
+{
+    rocksdb::Options options;
+    options.create_if_missing = true;
+    options.compaction_style = rocksdb::kCompactionStyleFIFO;
+    options.compaction_options_fifo.max_table_files_size = maxBytes;
+    open(options, pathDatabase);
+}
+
+void RocksDbWrapper::open(const rocksdb::Options& options, const std::string& pathDatabase)
+{
     rocksdb::DB* dbPtr = nullptr; // Declare a raw pointer
                                   // Ensure the pointer is not null
     if (dbPtr != nullptr)
@@ -5,6 +5,20 @@
 
 #include "client.hpp"
 
+namespace
+{
+ImageDownload imageDownload;
+
+void SetChannelConnected(bool connected)
+{
+    {
+        std::lock_guard<std::mutex> lock(imageDownload.mutex);
+        imageDownload.connected = connected;
+    }
+    imageDownload.channelChanged.notify_all();
+}
+} // namespace
+
 void GetCredentials(char* username, char* password)
 {
     std::cout << "[AUTHENTICATION]" << std::endl;
@@ -15,94 +29,128 @@ void GetCredentials(char* username, char* password)
     std::cin.getline(password, MAXLENGTHCLI);
 }
 
+bool ReadExact(int socket, char* data, std::size_t size)
+{
+    std::size_t received = 0;
+    while (received < size)
+    {
+        ssize_t NumBytes = read(socket, data + received, size - received);
+        if (NumBytes < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (NumBytes <= 0)
+        {
+            return false;
+        }
+        received += NumBytes;
+    }
+    return true;
+}
+
 void HandleTCPv6Client(std::unique_ptr<TCPv6Connection> client, const std::string& token)
 {
-    int NumBytes;
-    std::array<char, BUFSIZECLI> buffer;
-    bool FirstTime = true;
-    bool start = true;
-    int imageCounter = 0;
-    std::ofstream ImageFile;
-    std::stringstream ss;
-    std::streamsize totalBytesReceived = 0;
-    std::streamsize sizeCompressedImage = 0;
-    try
+    int socket = client->getSocket();
+    int receiveBufferSize = RECVBUFSIZE;
+    setsockopt(socket, SOL_SOCKET, SO_RCVBUF, &receiveBufferSize, sizeof(receiveBufferSize));
+    std::vector<char> buffer(RECVBUFSIZE);
+    FrameBytes headerBytes;
+    FrameHeader header;
+
+    if (!ReadExact(socket, headerBytes.data(), headerBytes.size()) || !DecodeFrameHeader(headerBytes, header) ||
+        header.type != FrameType::Hello)
+    {
+        std::cerr << "Invalid handshake from the server." << std::endl;
+        SetChannelConnected(false);
+        return;
+    }
+    if (send(socket, token.c_str(), token.size(), 0) < 0)
+    {
+        perror("Writing to socket");
+        SetChannelConnected(false);
+        return;
+    }
+    SetChannelConnected(true);
+
+    while (ReadExact(socket, headerBytes.data(), headerBytes.size()))
     {
-        while (true)
+        if (!DecodeFrameHeader(headerBytes, header) || header.type != FrameType::Image)
         {
-            if (FirstTime)
-            {
-                NumBytes = read(client->getSocket(), &sizeCompressedImage, sizeof(sizeCompressedImage));
-                if (NumBytes < 0)
-                {
-                    perror("Socket read");
-                    exit(EXIT_FAILURE);
-                }
+            std::cerr << "Invalid frame from the server." << std::endl;
+            break;
+        }
 
-                ss << token;
-                std::string message = ss.str();
-                NumBytes = send(client->getSocket(), message.c_str(), message.size(), 0);
-                if (NumBytes < 0)
-                {
-                    perror("Writing to socket");
-                    exit(EXIT_FAILURE);
-                }
-                FirstTime = false;
+        std::ofstream ImageFile;
+        {
+            std::lock_guard<std::mutex> lock(imageDownload.mutex);
+            bool resume = header.offset > 0 && header.hash == imageDownload.hash &&
+                          header.offset == imageDownload.received;
+            if (header.offset > 0 && !resume)
+            {
+                std::cerr << "Unexpected resume offset from the server." << std::endl;
+                break;
             }
-            else
+            if (!resume)
             {
-                if (start)
-                {
-                    std::ostringstream imageName;
-                    imageName << RECIMAGE << token << "_" << imageCounter << ".tar.gz";
-                    ImageFile.open(imageName.str(), std::ios::binary);
-                    if (!ImageFile.is_open())
-                    {
-                        std::cerr << "Error opening image file for writing." << std::endl;
-                        return;
-                    }
-                    start = false;
-                }
-                std::fill(buffer.begin(), buffer.end(), 0);
-                NumBytes = read(client->getSocket(), buffer.data(), BUFSIZECLI);
-
-                if (NumBytes < 0)
-                {
-                    perror("Read from socket");
-                    if (close(client->getSocket()) < 0)
-                    {
-                        perror("Close");
-                    }
-                    exit(EXIT_FAILURE);
-                }
+                std::ostringstream imageName;
+                imageName << RECIMAGE << token << "_" << imageDownload.imageCounter++ << ".edge";
+                imageDownload.fileName = imageName.str();
+                imageDownload.hash = header.hash;
+                imageDownload.totalSize = header.totalSize;
+                imageDownload.received = 0;
+                imageDownload.runningHash = FNVOFFSET;
+            }
+            ImageFile.open(imageDownload.fileName, resume ? std::ios::binary | std::ios::app : std::ios::binary);
+        }
+        if (!ImageFile.is_open())
+        {
+            std::cerr << "Error opening image file for writing." << std::endl;
+            break;
+        }
 
-                if (NumBytes == 0)
-                {
-                    continue;
-                }
+        std::uint64_t remaining = header.length;
+        while (remaining > 0)
+        {
+            std::size_t size = std::min<std::uint64_t>(remaining, buffer.size());
+            if (!ReadExact(socket, buffer.data(), size))
+            {
+                std::cerr << "Connection closed in the middle of an image, it will be resumed." << std::endl;
+                SetChannelConnected(false);
+                return;
+            }
+            if (!ImageFile.write(buffer.data(), size).flush())
+            {
+                std::cerr << "Error writing to image file." << std::endl;
+                SetChannelConnected(false);
+                return;
+            }
+            std::lock_guard<std::mutex> lock(imageDownload.mutex);
+            imageDownload.runningHash = ContentHash(buffer.data(), size, imageDownload.runningHash);
+            imageDownload.received += size;
+            remaining -= size;
+        }
 
-                ImageFile.write(buffer.data(), NumBytes);
-                if (!ImageFile)
-                {
-                    std::cerr << "Error writing to image file." << std::endl;
-                    break;
-                }
-                totalBytesReceived += NumBytes;
-                if (totalBytesReceived >= sizeCompressedImage)
-                {
-                    ImageFile.close();
-                    start = true;
-                    imageCounter++;
-                    totalBytesReceived = 0;
-                }
+        std::string fileName;
+        {
+            std::lock_guard<std::mutex> lock(imageDownload.mutex);
+            if (imageDownload.runningHash != header.hash)
+            {
+                std::cerr << "Error receiving image " << imageDownload.fileName << std::endl;
+                imageDownload.hash = 0;
+                imageDownload.received = 0;
+                continue;
             }
+            fileName = imageDownload.fileName;
+        }
+        if (header.compression == FrameCompression::EdgeMap)
+        {
+            std::ifstream EncodedFile(fileName, std::ios::binary);
+            std::vector<char> encoded((std::istreambuf_iterator<char>(EncodedFile)), std::istreambuf_iterator<char>());
+            SaveEdgeMapAsPgm(encoded.data(), encoded.size(), fileName.substr(0, fileName.find_last_of('.')) + ".pgm");
         }
     }
-    catch (const std::runtime_error& e)
-    {
-        std::cerr << "Error in TCPv6Client: " << e.what() << std::endl;
-        ImageFile.close();
-    }
+    std::cerr << "Image channel closed." << std::endl;
+    SetChannelConnected(false);
 }
 
 int ReadPortFromThirdLine(const std::string& filename)
@@ -169,14 +217,249 @@ void GetAlerts(httplib::Client& cli)
 
 void GetImage(httplib::Client& cli)
 {
-    auto res = cli.Get("/image");
+    static std::string etag;
+    httplib::Headers headers;
+    if (!etag.empty())
+    {
+        headers.emplace("If-None-Match", etag);
+    }
+
+    auto res = cli.Get("/image", headers);
+    if (res && res->status == NOTMODIFIED)
+    {
+        std::cout << "Image up to date" << std::endl;
+    }
+    else if (res && res->status == SUCCESS)
+    {
+        if (!SaveEdgeMapAsPgm(res->body.data(), res->body.size(), HTTPIMAGE))
+        {
+            return;
+        }
+        etag = res->get_header_value("ETag");
+        std::cout << "Image saved to " << HTTPIMAGE << std::endl;
+    }
+    else
+    {
+        std::cout << "Failed to retrieve image. Status code: " << (res ? res->status : -1) << std::endl;
+    }
+}
+
+void GetSegments(httplib::Client& cli)
+{
+    auto res = cli.Get("/image?format=segments");
+    if (!res || res->status != SUCCESS)
+    {
+        std::cout << "Failed to retrieve segments. Status code: " << (res ? res->status : -1) << std::endl;
+        return;
+    }
+
+    std::ofstream SegmentsFile(HTTPSEGMENTS);
+    SegmentsFile << res->body;
+    if (!SegmentsFile)
+    {
+        std::cerr << "Error writing to segments file." << std::endl;
+        return;
+    }
+    nlohmann::json document = nlohmann::json::parse(res->body, nullptr, false);
+    std::size_t segments = document.is_object() ? document.value("segments", nlohmann::json::array()).size() : 0;
+    std::cout << segments << " segments saved to " << HTTPSEGMENTS << std::endl;
+}
+
+void GetDensity(httplib::Client& cli)
+{
+    auto res = cli.Get("/density");
     if (res && res->status == SUCCESS)
     {
-        std::cout << "Server response: " << res->body << std::endl;
+        std::cout << "Server response... Edge density:" << res->body << std::endl;
+    }
+    else
+    {
+        std::cout << "Failed to retrieve edge density. Status code: " << (res ? res->status : -1) << std::endl;
+    }
+}
+
+bool SaveEdgeMapAsPgm(const char* data, std::size_t size, const std::string& fileName)
+{
+    EdgeMap edges;
+    try
+    {
+        edges = DecodeEdgeMap(data, size);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error decoding image: " << e.what() << std::endl;
+        return false;
+    }
+
+    std::ofstream ImageFile(fileName, std::ios::binary);
+    ImageFile << "P5\n" << edges.cols << " " << edges.rows << "\n255\n";
+    ImageFile.write(reinterpret_cast<const char*>(edges.pixels.data()), edges.pixels.size());
+    if (!ImageFile)
+    {
+        std::cerr << "Error writing to image file." << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void UploadImage(httplib::Client& cli, const std::string& token, const std::string& command)
+{
+    std::istringstream iss(command);
+    std::string word;
+    std::string path;
+    int priority = 0;
+    std::string low;
+    std::string high;
+    std::string sigma;
+    iss >> word >> path >> priority >> low >> high >> sigma;
+    std::string query = "/upload?token=" + token + "&priority=" + std::to_string(priority);
+    if (!sigma.empty())
+    {
+        query += "&low=" + low + "&high=" + high + "&sigma=" + sigma;
+    }
+
+    auto ImageFile = std::make_shared<std::ifstream>(path, std::ios::binary | std::ios::ate);
+    if (path.empty() || !ImageFile->is_open())
+    {
+        std::cerr << "Unable to open file: " << path << std::endl;
+        return;
+    }
+    std::size_t size = ImageFile->tellg();
+    ImageFile->seekg(0);
+
+    auto res = cli.Post(
+        query, size,
+        [ImageFile](std::size_t offset, std::size_t length, httplib::DataSink& sink) {
+            std::vector<char> buffer(std::min<std::size_t>(length, UPLOADCHUNK));
+            ImageFile->seekg(offset);
+            if (!ImageFile->read(buffer.data(), buffer.size()))
+            {
+                return false;
+            }
+            return sink.write(buffer.data(), buffer.size());
+        },
+        "application/octet-stream");
+    if (res && res->status == ACCEPTED)
+    {
+        std::cout << "Image queued: " << res->body << std::endl;
+    }
+    else
+    {
+        std::cout << "Failed to upload image. Status code: " << (res ? res->status : -1) << std::endl;
+    }
+}
+
+void GetJobResult(httplib::Client& cli, const std::string& command)
+{
+    std::string id = command.size() > 7 ? command.substr(7) : "";
+    auto res = cli.Get("/jobs/" + id + "/result");
+    if (res && res->status == SUCCESS)
+    {
+        std::string fileName = JOBIMAGE + id + ".pgm";
+        if (SaveEdgeMapAsPgm(res->body.data(), res->body.size(), fileName))
+        {
+            std::cout << "Image saved to " << fileName << std::endl;
+        }
+    }
+    else if (res && res->status == ACCEPTED)
+    {
+        if (WaitForJob(cli, id))
+        {
+            GetJobResult(cli, command);
+        }
     }
     else
     {
-        std::cout << "Failed to retrieve image. Status code: " << res->status << std::endl;
+        std::cout << "Failed to retrieve job. Status code: " << (res ? res->status : -1) << " "
+                  << (res ? res->body : "") << std::endl;
+    }
+}
+
+void RequestImage(httplib::Client& cli, httplib::Params& params, const std::string& token, const char* hostname)
+{
+    std::unique_lock<std::mutex> lock(imageDownload.mutex);
+    if (!imageDownload.connected)
+    {
+        lock.unlock();
+        try
+        {
+            establishConnection(hostname, token);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Error reopening the image channel: " << e.what() << std::endl;
+            return;
+        }
+        lock.lock();
+        if (!imageDownload.channelChanged.wait_for(lock, std::chrono::seconds(HANDSHAKETIMEOUT),
+                                                   [] { return imageDownload.connected; }))
+        {
+            std::cerr << "Could not reopen the image channel." << std::endl;
+            return;
+        }
+    }
+
+    params.clear();
+    params.emplace("command", "image");
+    params.emplace("token", token);
+    if (imageDownload.hash != 0)
+    {
+        params.emplace("hash", std::to_string(imageDownload.hash));
+        params.emplace("offset", std::to_string(imageDownload.received));
+    }
+    lock.unlock();
+
+    auto res = cli.Post("/", params);
+    if (res && res->status == SUCCESS)
+    {
+        std::cout << "Server response: " << res->body << std::endl;
+        std::size_t pos = res->body.find("job:");
+        if (startsWith(res->body, "Processing image") && pos != std::string::npos &&
+            WaitForJob(cli, res->body.substr(pos + 4)))
+        {
+            res = cli.Post("/", params);
+            if (res && res->status == SUCCESS)
+            {
+                std::cout << "Server response: " << res->body << std::endl;
+            }
+        }
+    }
+}
+
+bool WaitForJob(httplib::Client& cli, const std::string& id)
+{
+    int progress = -1;
+    while (true)
+    {
+        std::string path = "/jobs/" + id + "?wait=" + std::to_string(JOBWAIT);
+        if (progress >= 0)
+        {
+            path += "&progress=" + std::to_string(progress);
+        }
+        auto res = cli.Get(path);
+        if (!res || res->status != SUCCESS)
+        {
+            std::cout << "Failed to follow job " << id << ". Status code: " << (res ? res->status : -1) << std::endl;
+            return false;
+        }
+
+        nlohmann::json job = nlohmann::json::parse(res->body, nullptr, false);
+        std::string state = job.is_object() ? job.value("state", "") : "";
+        if (job.is_object() && job.value("progress", 0) != progress)
+        {
+            progress = job.value("progress", 0);
+            std::cout << "Job " << id << " " << state << ": " << progress << "%" << std::endl;
+        }
+        if (state == "done")
+        {
+            return true;
+        }
+        if (state != "queued" && state != "running")
+        {
+            std::cout << "Job " << id << " failed: " << (job.is_object() ? job.value("error", "") : res->body)
+                      << std::endl;
+            return false;
+        }
     }
 }
 
@@ -250,7 +533,8 @@ void HandleCommunication(httplib::Client& cli, const char* username, const char*
             {
                 std::cout << "Enter 'modify' field to change (e.g., 'meat') amount (e.g., '15') or..." << std::endl;
             }
-            std::cout << "Enter 'supplies' or 'alerts' or 'image' or 'end': ";
+            std::cout << "Enter 'supplies', 'alerts', 'image', 'download', 'segments', "
+                      << "'upload' path [priority [low high sigma]], 'result' id, 'density' or 'end': ";
             std::getline(std::cin, command);
             if (command == "supplies")
             {
@@ -260,7 +544,31 @@ void HandleCommunication(httplib::Client& cli, const char* username, const char*
             {
                 GetAlerts(cli);
             }
-            else if ((command == "image") || (command == "end") || (startsWith(command, "modify")))
+            else if (command == "image")
+            {
+                RequestImage(cli, params, token, hostname);
+            }
+            else if (command == "download")
+            {
+                GetImage(cli);
+            }
+            else if (command == "segments")
+            {
+                GetSegments(cli);
+            }
+            else if (command == "density")
+            {
+                GetDensity(cli);
+            }
+            else if (startsWith(command, "upload "))
+            {
+                UploadImage(cli, token, command);
+            }
+            else if (startsWith(command, "result "))
+            {
+                GetJobResult(cli, command);
+            }
+            else if ((command == "end") || (startsWith(command, "modify")))
             {
                 PostImageModifyOrEnd(cli, params, command, token);
                 if ((command == "end"))
@@ -311,6 +619,8 @@ int main(int argc, char* argv[])
     std::cout << "--- WELCOME " << username << " ---" << std::endl;
 
     httplib::Client cli(hostname, port);
+    // The job long-polls keep the answer for up to JOBWAIT seconds
+    cli.set_read_timeout(JOBWAIT + HANDSHAKETIMEOUT, 0);
     HandleCommunication(cli, username, password, hostname.c_str());
 
     std::cout << "finished client." << std::endl;
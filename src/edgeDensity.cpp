@@ -0,0 +1,122 @@
+/**
+ * @file edgeDensity.cpp
+ * @brief Edge density summaries of the published edge map, per grid cell and per entry zone
+ */
+
+#include "edgeDensity.hpp"
+#include "edgeMapCodec.hpp"
+#include <algorithm>
+#include <bit>
+#include <nlohmann/json.hpp>
+
+namespace
+{
+constexpr std::size_t WORDBITS = 64;
+
+std::uint64_t CountRange(const std::vector<std::uint64_t>& words, std::size_t begin, std::size_t end)
+{
+    std::uint64_t count = 0;
+    for (std::size_t word = begin / WORDBITS; word * WORDBITS < end; ++word)
+    {
+        std::uint64_t bits = words[word];
+        if (word == begin / WORDBITS)
+        {
+            bits &= ~std::uint64_t {0} << (begin % WORDBITS);
+        }
+        if ((word + 1) * WORDBITS > end)
+        {
+            bits &= (std::uint64_t {1} << (end % WORDBITS)) - 1;
+        }
+        count += std::popcount(bits);
+    }
+    return count;
+}
+
+double Share(std::uint64_t edges, std::uint64_t pixels)
+{
+    return pixels == 0 ? 0.0 : static_cast<double>(edges) / pixels;
+}
+} // namespace
+
+std::string EdgeDensity::toJson() const
+{
+    nlohmann::json summary;
+    summary["version"] = version;
+    summary["rows"] = rows;
+    summary["cols"] = cols;
+    summary["grid"] = grid;
+    summary["total"] = total;
+    summary["cells"] = cells;
+    summary["zones"] = zones;
+    return summary.dump();
+}
+
+EdgeDensity ComputeEdgeDensity(const std::uint8_t* pixels, std::uint32_t rows, std::uint32_t cols, int grid)
+{
+    grid = std::clamp(grid, 1, static_cast<int>(std::max(1U, std::min(rows, cols))));
+    const std::uint32_t northEnd = std::max(1U, static_cast<std::uint32_t>(rows * DENSITYZONESHARE));
+    const std::uint32_t westEnd = std::max(1U, static_cast<std::uint32_t>(cols * DENSITYZONESHARE));
+    const std::uint32_t southBegin = rows - std::min(rows, northEnd);
+    const std::uint32_t eastBegin = cols - std::min(cols, westEnd);
+
+    // Counts of every row, one slot per grid column, then the west and east bands and the whole row
+    const int slots = grid + 3;
+    std::vector<std::uint64_t> counts(static_cast<std::size_t>(rows) * slots, 0);
+#pragma omp parallel for schedule(static)
+    for (std::int64_t row = 0; row < static_cast<std::int64_t>(rows); ++row)
+    {
+        const std::vector<std::uint64_t> words = PackEdgePixels(pixels + row * cols, cols);
+        std::uint64_t* rowCounts = counts.data() + row * slots;
+        for (int cell = 0; cell < grid; ++cell)
+        {
+            rowCounts[cell] = CountRange(words, static_cast<std::size_t>(cols) * cell / grid,
+                                         static_cast<std::size_t>(cols) * (cell + 1) / grid);
+        }
+        rowCounts[grid] = CountRange(words, 0, std::min(cols, westEnd));
+        rowCounts[grid + 1] = CountRange(words, eastBegin, cols);
+        for (int cell = 0; cell < grid; ++cell)
+        {
+            rowCounts[grid + 2] += rowCounts[cell];
+        }
+    }
+
+    EdgeDensity density {0, rows, cols, grid, 0.0, std::vector<double>(static_cast<std::size_t>(grid) * grid), {}};
+    std::vector<std::uint64_t> cellEdges(density.cells.size(), 0);
+    std::vector<std::uint64_t> bandRows(grid, 0);
+    std::uint64_t total = 0;
+    std::uint64_t north = 0;
+    std::uint64_t south = 0;
+    std::uint64_t west = 0;
+    std::uint64_t east = 0;
+    for (std::uint32_t row = 0; row < rows; ++row)
+    {
+        const std::uint64_t* rowCounts = counts.data() + static_cast<std::size_t>(row) * slots;
+        const std::size_t band = static_cast<std::size_t>(row) * grid / rows;
+        ++bandRows[band];
+        for (int cell = 0; cell < grid; ++cell)
+        {
+            cellEdges[band * grid + cell] += rowCounts[cell];
+        }
+        west += rowCounts[grid];
+        east += rowCounts[grid + 1];
+        total += rowCounts[grid + 2];
+        north += row < northEnd ? rowCounts[grid + 2] : 0;
+        south += row >= southBegin ? rowCounts[grid + 2] : 0;
+    }
+
+    for (int band = 0; band < grid; ++band)
+    {
+        for (int cell = 0; cell < grid; ++cell)
+        {
+            const std::uint64_t width = static_cast<std::uint64_t>(cols) * (cell + 1) / grid -
+                                        static_cast<std::uint64_t>(cols) * cell / grid;
+            density.cells[band * grid + cell] = Share(cellEdges[band * grid + cell], bandRows[band] * width);
+        }
+    }
+    density.total = Share(total, static_cast<std::uint64_t>(rows) * cols);
+    density.zones["north_entry"] = Share(north, static_cast<std::uint64_t>(std::min(rows, northEnd)) * cols);
+    density.zones["south_entry"] = Share(south, static_cast<std::uint64_t>(rows - southBegin) * cols);
+    density.zones["west_entry"] = Share(west, static_cast<std::uint64_t>(rows) * std::min(cols, westEnd));
+    density.zones["east_entry"] = Share(east, static_cast<std::uint64_t>(rows) * (cols - eastBegin));
+    return density;
+}
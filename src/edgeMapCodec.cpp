@@ -0,0 +1,323 @@
+/**
+ * @file edgeMapCodec.cpp
+ * @brief Compact encoding of binary edge maps, shared by the server and the client
+ */
+
+#include "edgeMapCodec.hpp"
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+#include <utility>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+constexpr std::size_t WORDBITS = 64;
+
+void PutLittleEndian(std::vector<char>& output, std::uint64_t value, std::size_t width)
+{
+    for (std::size_t i = 0; i < width; ++i)
+    {
+        output.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+std::uint64_t GetLittleEndian(const char* data, std::size_t width)
+{
+    std::uint64_t value = 0;
+    for (std::size_t i = 0; i < width; ++i)
+    {
+        value |= static_cast<std::uint64_t>(static_cast<unsigned char>(data[i])) << (8 * i);
+    }
+    return value;
+}
+
+void PutVarint(std::vector<char>& output, std::uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        output.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    output.push_back(static_cast<char>(value));
+}
+
+std::uint64_t GetVarint(const char*& data, const char* end)
+{
+    std::uint64_t value = 0;
+    for (int shift = 0; shift < 64 && data < end; shift += 7)
+    {
+        auto byte = static_cast<unsigned char>(*data++);
+        value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return value;
+        }
+    }
+    throw std::runtime_error("Truncated edge map");
+}
+
+std::uint64_t PackBits(const std::uint8_t* pixels)
+{
+#if defined(__SSE2__)
+    // A compare against zero sets the lanes of the background pixels, movemask gathers them as 16 bits
+    const __m128i zero = _mm_setzero_si128();
+    std::uint64_t word = 0;
+    for (int lane = 0; lane < 4; ++lane)
+    {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pixels + 16 * lane));
+        auto background = static_cast<std::uint64_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, zero)));
+        word |= (~background & 0xffff) << (16 * lane);
+    }
+    return word;
+#else
+    std::uint64_t word = 0;
+    for (std::size_t bit = 0; bit < WORDBITS; ++bit)
+    {
+        word |= static_cast<std::uint64_t>(pixels[bit] != 0) << bit;
+    }
+    return word;
+#endif
+}
+
+void UnpackBits(std::uint64_t word, std::uint8_t* pixels)
+{
+#if defined(__SSE2__)
+    // Every byte of the word is broadcast to 8 lanes, and each lane keeps the bit selected by its mask
+    const __m128i masks = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    for (int lane = 0; lane < 4; ++lane)
+    {
+        auto low = static_cast<char>((word >> (16 * lane)) & 0xff);
+        auto high = static_cast<char>((word >> (16 * lane + 8)) & 0xff);
+        __m128i bytes = _mm_unpacklo_epi64(_mm_set1_epi8(low), _mm_set1_epi8(high));
+        __m128i edges = _mm_cmpeq_epi8(_mm_and_si128(bytes, masks), masks);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(pixels + 16 * lane), edges);
+    }
+#else
+    for (std::size_t bit = 0; bit < WORDBITS; ++bit)
+    {
+        pixels[bit] = ((word >> bit) & 1) ? 255 : 0;
+    }
+#endif
+}
+
+std::uint64_t Transitions(const std::vector<std::uint64_t>& words, std::size_t word, std::size_t count)
+{
+    // Bit i is set when pixel i differs from pixel i - 1, the pixel before the first one being background
+    std::uint64_t previous = word > 0 ? words[word - 1] >> (WORDBITS - 1) : 0;
+    std::uint64_t transitions = words[word] ^ ((words[word] << 1) | previous);
+    std::size_t valid = count - word * WORDBITS;
+    if (valid < WORDBITS)
+    {
+        transitions &= (std::uint64_t {1} << valid) - 1;
+    }
+    return transitions;
+}
+
+void WritePacked(std::vector<char>& output, const std::vector<std::uint64_t>& words, std::size_t count)
+{
+    std::size_t bytes = (count + 7) / 8;
+    std::size_t position = output.size();
+    output.resize(position + bytes);
+    for (std::size_t byte = 0; byte < bytes; ++byte)
+    {
+        output[position + byte] = static_cast<char>((words[byte / 8] >> (8 * (byte % 8))) & 0xff);
+    }
+}
+
+void WriteRuns(std::vector<char>& output, const std::vector<std::uint64_t>& words, std::size_t count)
+{
+    std::uint64_t last = 0;
+    for (std::size_t word = 0; word < words.size(); ++word)
+    {
+        for (std::uint64_t bits = Transitions(words, word, count); bits != 0; bits &= bits - 1)
+        {
+            std::uint64_t position = word * WORDBITS + std::countr_zero(bits);
+            PutVarint(output, position - last);
+            last = position;
+        }
+    }
+    PutVarint(output, count - last);
+}
+
+void WriteSparse(std::vector<char>& output, const std::vector<std::uint64_t>& words)
+{
+    std::uint64_t next = 0;
+    for (std::size_t word = 0; word < words.size(); ++word)
+    {
+        for (std::uint64_t bits = words[word]; bits != 0; bits &= bits - 1)
+        {
+            std::uint64_t position = word * WORDBITS + std::countr_zero(bits);
+            PutVarint(output, position - next);
+            next = position + 1;
+        }
+    }
+}
+
+std::vector<char> EncodeWords(const std::vector<std::uint64_t>& words, std::uint32_t rows, std::uint32_t cols,
+                              EdgeMapMode mode)
+{
+    const std::size_t count = static_cast<std::size_t>(rows) * cols;
+    std::vector<char> output;
+    output.reserve(EDGEMAPHEADERSIZE + (mode == EdgeMapMode::Packed ? (count + 7) / 8 : 0));
+    PutLittleEndian(output, EDGEMAPMAGIC, 4);
+    PutLittleEndian(output, EDGEMAPVERSION, 1);
+    PutLittleEndian(output, static_cast<std::uint8_t>(mode), 1);
+    PutLittleEndian(output, 0, 2);
+    PutLittleEndian(output, cols, 4);
+    PutLittleEndian(output, rows, 4);
+
+    switch (mode)
+    {
+    case EdgeMapMode::Packed:
+        WritePacked(output, words, count);
+        break;
+    case EdgeMapMode::Runs:
+        WriteRuns(output, words, count);
+        break;
+    case EdgeMapMode::Sparse:
+        WriteSparse(output, words);
+        break;
+    default:
+        throw std::runtime_error("Unknown edge map mode");
+    }
+    return output;
+}
+} // namespace
+
+std::vector<std::uint64_t> PackEdgePixels(const std::uint8_t* pixels, std::size_t count)
+{
+    std::vector<std::uint64_t> words((count + WORDBITS - 1) / WORDBITS, 0);
+    std::size_t whole = count / WORDBITS;
+    for (std::size_t word = 0; word < whole; ++word)
+    {
+        words[word] = PackBits(pixels + word * WORDBITS);
+    }
+    for (std::size_t pixel = whole * WORDBITS; pixel < count; ++pixel)
+    {
+        words[whole] |= static_cast<std::uint64_t>(pixels[pixel] != 0) << (pixel % WORDBITS);
+    }
+    return words;
+}
+
+std::vector<char> EncodeEdgeMap(const std::uint8_t* pixels, std::uint32_t rows, std::uint32_t cols)
+{
+    const std::size_t count = static_cast<std::size_t>(rows) * cols;
+    const std::vector<std::uint64_t> words = PackEdgePixels(pixels, count);
+
+    std::size_t edges = 0;
+    std::size_t transitions = 0;
+    for (std::size_t word = 0; word < words.size(); ++word)
+    {
+        edges += std::popcount(words[word]);
+        transitions += std::popcount(Transitions(words, word, count));
+    }
+
+    // Every varint takes at least one byte, so a layout is only tried when its lower bound beats the bitmap
+    std::vector<char> best = EncodeWords(words, rows, cols, EdgeMapMode::Packed);
+    const std::size_t packedPayload = best.size() - EDGEMAPHEADERSIZE;
+    for (auto [mode, lowerBound] : {std::pair {EdgeMapMode::Sparse, edges},
+                                    std::pair {EdgeMapMode::Runs, transitions + 1}})
+    {
+        if (lowerBound < packedPayload)
+        {
+            std::vector<char> candidate = EncodeWords(words, rows, cols, mode);
+            if (candidate.size() < best.size())
+            {
+                best = std::move(candidate);
+            }
+        }
+    }
+    return best;
+}
+
+std::vector<char> EncodeEdgeMap(const std::uint8_t* pixels, std::uint32_t rows, std::uint32_t cols,
+                                EdgeMapMode mode)
+{
+    return EncodeWords(PackEdgePixels(pixels, static_cast<std::size_t>(rows) * cols), rows, cols, mode);
+}
+
+EdgeMap DecodeEdgeMap(const char* data, std::size_t size)
+{
+    if (size < EDGEMAPHEADERSIZE || GetLittleEndian(data, 4) != EDGEMAPMAGIC ||
+        GetLittleEndian(data + 4, 1) != EDGEMAPVERSION)
+    {
+        throw std::runtime_error("Not an edge map of a supported version");
+    }
+    auto mode = static_cast<EdgeMapMode>(GetLittleEndian(data + 5, 1));
+    EdgeMap map;
+    map.cols = static_cast<std::uint32_t>(GetLittleEndian(data + 8, 4));
+    map.rows = static_cast<std::uint32_t>(GetLittleEndian(data + 12, 4));
+    const std::size_t count = static_cast<std::size_t>(map.rows) * map.cols;
+    if (count > EDGEMAPMAXPIXELS)
+    {
+        throw std::runtime_error("Edge map too large");
+    }
+
+    const char* payload = data + EDGEMAPHEADERSIZE;
+    const char* end = data + size;
+    map.pixels.assign(count, 0);
+    switch (mode)
+    {
+    case EdgeMapMode::Packed:
+    {
+        if (static_cast<std::size_t>(end - payload) != (count + 7) / 8)
+        {
+            throw std::runtime_error("Truncated edge map");
+        }
+        std::size_t whole = count / WORDBITS;
+        for (std::size_t word = 0; word < whole; ++word)
+        {
+            UnpackBits(GetLittleEndian(payload + word * 8, 8), map.pixels.data() + word * WORDBITS);
+        }
+        for (std::size_t pixel = whole * WORDBITS; pixel < count; ++pixel)
+        {
+            map.pixels[pixel] = ((payload[pixel / 8] >> (pixel % 8)) & 1) ? 255 : 0;
+        }
+        break;
+    }
+    case EdgeMapMode::Runs:
+    {
+        std::uint64_t position = 0;
+        for (bool edge = false; payload < end; edge = !edge)
+        {
+            std::uint64_t run = GetVarint(payload, end);
+            if (run > count - position)
+            {
+                throw std::runtime_error("Edge map run out of bounds");
+            }
+            if (edge)
+            {
+                std::fill_n(map.pixels.begin() + position, run, 255);
+            }
+            position += run;
+        }
+        if (position != count)
+        {
+            throw std::runtime_error("Truncated edge map");
+        }
+        break;
+    }
+    case EdgeMapMode::Sparse:
+    {
+        std::uint64_t next = 0;
+        while (payload < end)
+        {
+            std::uint64_t gap = GetVarint(payload, end);
+            if (gap >= count - next)
+            {
+                throw std::runtime_error("Edge map pixel out of bounds");
+            }
+            map.pixels[next + gap] = 255;
+            next += gap + 1;
+        }
+        break;
+    }
+    default:
+        throw std::runtime_error("Unknown edge map mode");
+    }
+    return map;
+}
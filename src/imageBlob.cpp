@@ -0,0 +1,83 @@
+/**
+ * @file imageBlob.cpp
+ * @brief Immutable compressed image shared by every download in flight
+ */
+
+#include "imageBlob.hpp"
+#include "contentHash.hpp"
+#include <cerrno>
+#include <iostream>
+#include <sys/mman.h>
+#include <unistd.h>
+
+ImageBlob::ImageBlob(std::vector<char>&& data, std::uint64_t version, FrameCompression encoding, bool inMemoryFile)
+    : m_data(std::move(data)), m_hash(ContentHash(m_data.data(), m_data.size())), m_version(version),
+      m_encoding(encoding), m_publishTime(std::chrono::system_clock::now()),
+      m_fd(inMemoryFile ? memfd_create("image-blob", MFD_CLOEXEC) : -1)
+{
+    if (!inMemoryFile)
+    {
+        return;
+    }
+    if (m_fd < 0)
+    {
+        std::cerr << "Zero-copy delivery disabled: error creating in-memory file" << std::endl;
+        return;
+    }
+    std::size_t written = 0;
+    while (written < m_data.size())
+    {
+        ssize_t result = write(m_fd, m_data.data() + written, m_data.size() - written);
+        if (result < 0 && errno != EINTR)
+        {
+            std::cerr << "Zero-copy delivery disabled: error writing in-memory file" << std::endl;
+            close(m_fd);
+            m_fd = -1;
+            return;
+        }
+        written += result > 0 ? result : 0;
+    }
+}
+
+ImageBlob::~ImageBlob()
+{
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+    }
+}
+
+const char* ImageBlob::data() const
+{
+    return m_data.data();
+}
+
+std::size_t ImageBlob::size() const
+{
+    return m_data.size();
+}
+
+std::uint64_t ImageBlob::hash() const
+{
+    return m_hash;
+}
+
+std::uint64_t ImageBlob::version() const
+{
+    return m_version;
+}
+
+FrameCompression ImageBlob::encoding() const
+{
+    return m_encoding;
+}
+
+std::chrono::system_clock::time_point ImageBlob::publishTime() const
+{
+    return m_publishTime;
+}
+
+int ImageBlob::fd() const
+{
+    return m_fd;
+}
@@ -0,0 +1,155 @@
+/**
+ * @file imageCompression.cpp
+ * @brief In-memory tar and gzip encoding of the images sent to the clients
+ */
+
+#include "imageCompression.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <ctime>
+#include <stdexcept>
+#include <zlib.h>
+
+namespace
+{
+constexpr std::size_t DICTIONARYSIZE = 32 * 1024;
+constexpr std::size_t GZIPHEADER = 10;
+constexpr std::size_t GZIPTRAILER = 8;
+
+void WriteOctal(char* field, std::size_t width, std::uint64_t value)
+{
+    // Zero padded octal digits followed by a NUL, as tar expects
+    field[width - 1] = '\0';
+    for (std::size_t digit = width - 1; digit > 0; --digit)
+    {
+        field[digit - 1] = static_cast<char>('0' + (value & 7));
+        value >>= 3;
+    }
+}
+
+std::vector<char> DeflateBlock(const char* data, std::size_t size, const char* dictionary, std::size_t dictionarySize,
+                               int level, bool last)
+{
+    z_stream stream {};
+    if (deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        throw std::runtime_error("Error initializing deflate");
+    }
+    if (dictionarySize > 0)
+    {
+        deflateSetDictionary(&stream, reinterpret_cast<const Bytef*>(dictionary), static_cast<uInt>(dictionarySize));
+    }
+
+    // deflateBound does not count the empty stored block of the sync flush
+    std::vector<char> output(deflateBound(&stream, size) + 16);
+    stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    stream.avail_in = static_cast<uInt>(size);
+    stream.next_out = reinterpret_cast<Bytef*>(output.data());
+    stream.avail_out = static_cast<uInt>(output.size());
+
+    int result = deflate(&stream, last ? Z_FINISH : Z_SYNC_FLUSH);
+    std::size_t produced = stream.total_out;
+    deflateEnd(&stream);
+    if (result != (last ? Z_STREAM_END : Z_OK) || stream.avail_in != 0)
+    {
+        throw std::runtime_error("Error compressing block");
+    }
+    output.resize(produced);
+    return output;
+}
+} // namespace
+
+std::vector<char> BuildTarArchive(const std::string& fileName, const char* data, std::size_t size)
+{
+    if (fileName.size() >= 100)
+    {
+        throw std::runtime_error("File name too long for tar header: " + fileName);
+    }
+
+    std::size_t paddedSize = (size + TARBLOCK - 1) / TARBLOCK * TARBLOCK;
+    std::vector<char> archive(TARBLOCK + paddedSize + 2 * TARBLOCK, 0);
+    char* header = archive.data();
+
+    std::memcpy(header, fileName.c_str(), fileName.size());
+    WriteOctal(header + 100, 8, 0644);
+    WriteOctal(header + 108, 8, 0);
+    WriteOctal(header + 116, 8, 0);
+    WriteOctal(header + 124, 12, size);
+    WriteOctal(header + 136, 12, static_cast<std::uint64_t>(std::time(nullptr)));
+    header[156] = '0';
+    std::memcpy(header + 257, "ustar", 6);
+    std::memcpy(header + 263, "00", 2);
+
+    // The checksum is computed with its own field filled with spaces
+    std::memset(header + 148, ' ', 8);
+    unsigned int checksum = 0;
+    for (int i = 0; i < TARBLOCK; ++i)
+    {
+        checksum += static_cast<unsigned char>(header[i]);
+    }
+    WriteOctal(header + 148, 7, checksum);
+
+    std::memcpy(archive.data() + TARBLOCK, data, size);
+    return archive;
+}
+
+std::vector<char> GzipCompress(const char* data, std::size_t size, int level, std::size_t blockSize)
+{
+    const std::size_t blockCount = std::max<std::size_t>(1, (size + blockSize - 1) / blockSize);
+    std::vector<std::vector<char>> blocks(blockCount);
+    std::vector<uLong> crcs(blockCount);
+    std::exception_ptr error;
+
+#pragma omp parallel for schedule(dynamic)
+    for (std::size_t block = 0; block < blockCount; ++block)
+    {
+        std::size_t begin = block * blockSize;
+        std::size_t length = std::min(blockSize, size - begin);
+        std::size_t dictionarySize = std::min(DICTIONARYSIZE, begin);
+        try
+        {
+            blocks[block] = DeflateBlock(data + begin, length, data + begin - dictionarySize, dictionarySize, level,
+                                         block == blockCount - 1);
+        }
+        catch (...)
+        {
+#pragma omp critical
+            error = std::current_exception();
+        }
+        crcs[block] = crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef*>(data + begin), length);
+    }
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+
+    uLong crc = crcs[0];
+    std::size_t compressedSize = 0;
+    for (std::size_t block = 0; block < blockCount; ++block)
+    {
+        if (block > 0)
+        {
+            crc = crc32_combine(crc, crcs[block], std::min(blockSize, size - block * blockSize));
+        }
+        compressedSize += blocks[block].size();
+    }
+
+    // Header without name nor timestamp, then the deflate blocks and the CRC and size trailer in little endian
+    const char header[GZIPHEADER] = {'\x1f', '\x8b', Z_DEFLATED, 0, 0, 0, 0, 0, 0, 3};
+    std::vector<char> gzip(GZIPHEADER + compressedSize + GZIPTRAILER);
+    char* output = std::copy(header, header + GZIPHEADER, gzip.data());
+    for (const auto& block : blocks)
+    {
+        output = std::copy(block.begin(), block.end(), output);
+    }
+    for (std::uint32_t value : {static_cast<std::uint32_t>(crc), static_cast<std::uint32_t>(size)})
+    {
+        for (int byte = 0; byte < 4; ++byte)
+        {
+            *output++ = static_cast<char>((value >> (8 * byte)) & 0xff);
+        }
+    }
+    return gzip;
+}
@@ -0,0 +1,115 @@
+/**
+ * @file imageHttp.cpp
+ * @brief HTTP delivery of the published image and of its variants, with conditional requests
+ */
+
+#include "imageHttp.hpp"
+#include "edgeMapCodec.hpp"
+#include <array>
+#include <chrono>
+#include <ctime>
+#include <sstream>
+
+bool MatchesIfNoneMatch(const std::string& header, const std::string& etag)
+{
+    std::size_t position = 0;
+    while (position < header.size())
+    {
+        position = header.find_first_not_of(" \t,", position);
+        if (position == std::string::npos)
+        {
+            return false;
+        }
+        if (header[position] == '*')
+        {
+            return true;
+        }
+        if (header.compare(position, 2, "W/") == 0)
+        {
+            position += 2;
+        }
+        if (header[position] != '"')
+        {
+            return false;
+        }
+
+        // Entity tags are quoted and hold no quote, so the tag ends at the next one
+        std::size_t end = header.find('"', position + 1);
+        if (end == std::string::npos)
+        {
+            return false;
+        }
+        if (header.compare(position, end + 1 - position, etag) == 0)
+        {
+            return true;
+        }
+        position = end + 1;
+    }
+    return false;
+}
+
+void ServeImage(const httplib::Request& req, httplib::Response& res, std::shared_ptr<const ImageBlob> image,
+                VariantCache& variantCache)
+{
+    std::ostringstream etag;
+    std::string contentType = EDGEMAPCONTENTTYPE;
+    if (req.has_param("width") || req.has_param("format") || req.has_param("level"))
+    {
+        VariantKey key {image->version(), 0, VariantFormat::Png, 0};
+        if (req.has_param("format") && !ParseVariantFormat(req.get_param_value("format"), key.format))
+        {
+            res.status = 400;
+            res.set_content("Unknown format", "text/plain");
+            return;
+        }
+        try
+        {
+            key.width = req.has_param("width") ? std::stoi(req.get_param_value("width")) : 0;
+            key.level = req.has_param("level") ? std::stoi(req.get_param_value("level"))
+                                               : DefaultVariantLevel(key.format);
+            image = variantCache.get(key);
+        }
+        catch (const std::exception& e)
+        {
+            res.status = 400;
+            res.set_content(std::string("Invalid variant: ") + e.what(), "text/plain");
+            return;
+        }
+        if (!image)
+        {
+            res.status = 503;
+            res.set_header("Retry-After", "1");
+            res.set_content("Image changed. Try again", "text/plain");
+            return;
+        }
+        etag << '"' << key.str() << '-';
+        contentType = VariantContentType(key.format);
+    }
+    else
+    {
+        etag << '"';
+        res.set_header("Content-Disposition", "attachment; filename=\"canny.edge\"");
+    }
+    etag << std::hex << image->hash() << '-' << std::dec << image->version() << '"';
+
+    std::time_t published = std::chrono::system_clock::to_time_t(image->publishTime());
+    std::tm publishedTm;
+    gmtime_r(&published, &publishedTm);
+    std::array<char, HTTPDATEBUF> lastModified;
+    std::strftime(lastModified.data(), lastModified.size(), "%a, %d %b %Y %H:%M:%S GMT", &publishedTm);
+
+    res.set_header("ETag", etag.str());
+    res.set_header("Last-Modified", lastModified.data());
+    res.set_header("Cache-Control", "no-cache");
+
+    if (MatchesIfNoneMatch(req.get_header_value("If-None-Match"), etag.str()))
+    {
+        res.status = 304;
+        return;
+    }
+
+    res.set_content_provider(image->size(), contentType,
+                             [image](std::size_t offset, std::size_t length, httplib::DataSink& sink) {
+                                 return sink.write(image->data() + offset, length);
+                             });
+}
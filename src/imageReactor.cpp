@@ -0,0 +1,364 @@
+/**
+ * @file imageReactor.cpp
+ * @brief Event loop serving the TCPv6 image channel: accept, token handshake and image streaming
+ */
+
+#include "imageReactor.hpp"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <fcntl.h>
+#include <iostream>
+#include <stdexcept>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+ImageReactor::ImageReactor(ImageProvider currentImage, TokenHandler onToken, CloseHandler onClose, std::size_t threads)
+    : m_currentImage(std::move(currentImage)), m_onToken(std::move(onToken)), m_onClose(std::move(onClose)),
+      m_listenSocket(-1), m_running(true)
+{
+    for (std::size_t i = 0; i < std::max<std::size_t>(threads, 1); ++i)
+    {
+        auto worker = std::make_unique<Worker>();
+        worker->epollFd = epoll_create1(EPOLL_CLOEXEC);
+        worker->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (worker->epollFd < 0 || worker->wakeFd < 0)
+        {
+            throw std::runtime_error("Error creating the image channel event loop");
+        }
+        epoll_event event {};
+        event.events = EPOLLIN;
+        event.data.fd = worker->wakeFd;
+        epoll_ctl(worker->epollFd, EPOLL_CTL_ADD, worker->wakeFd, &event);
+        m_workers.push_back(std::move(worker));
+    }
+    for (auto& worker : m_workers)
+    {
+        worker->thread = std::thread(&ImageReactor::run, this, std::ref(*worker));
+    }
+}
+
+ImageReactor::~ImageReactor()
+{
+    m_running = false;
+    for (auto& worker : m_workers)
+    {
+        std::uint64_t one = 1;
+        write(worker->wakeFd, &one, sizeof(one));
+    }
+    for (auto& worker : m_workers)
+    {
+        worker->thread.join();
+        for (const auto& [socket, connection] : worker->connections)
+        {
+            close(socket);
+        }
+        close(worker->wakeFd);
+        close(worker->epollFd);
+    }
+}
+
+void ImageReactor::listen(int listenSocket)
+{
+    fcntl(listenSocket, F_SETFL, fcntl(listenSocket, F_GETFL) | O_NONBLOCK);
+    m_listenSocket = listenSocket;
+
+    // Only the first thread accepts, the connections are then spread over all of them
+    epoll_event event {};
+    event.events = EPOLLIN | EPOLLET;
+    event.data.fd = listenSocket;
+    if (epoll_ctl(m_workers.front()->epollFd, EPOLL_CTL_ADD, listenSocket, &event) < 0)
+    {
+        throw std::runtime_error("Error watching the listening socket");
+    }
+}
+
+void ImageReactor::enqueue(int socket, std::shared_ptr<const ImageBlob> image, std::uint64_t offset)
+{
+    post({RequestType::Send, socket, std::move(image), offset});
+}
+
+void ImageReactor::post(Request request)
+{
+    std::uint64_t one = 1;
+    Worker& worker = *m_workers[request.socket % m_workers.size()];
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.incoming.push_back(std::move(request));
+    }
+    write(worker.wakeFd, &one, sizeof(one));
+}
+
+void ImageReactor::run(Worker& worker)
+{
+    std::array<epoll_event, EPOLLEVENTS> events;
+    while (m_running)
+    {
+        int count = epoll_wait(worker.epollFd, events.data(), EPOLLEVENTS, -1);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            std::cerr << "Error waiting for image channel sockets" << std::endl;
+            return;
+        }
+
+        for (int i = 0; i < count; ++i)
+        {
+            int socket = events[i].data.fd;
+            if (socket == worker.wakeFd)
+            {
+                takeRequests(worker);
+            }
+            else if (socket == m_listenSocket)
+            {
+                acceptConnections();
+            }
+            else if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP))
+            {
+                closeConnection(worker, socket);
+                std::cout << "Image channel closed for socket:" << socket << std::endl;
+            }
+            else
+            {
+                advance(worker, socket);
+            }
+        }
+    }
+}
+
+void ImageReactor::acceptConnections()
+{
+    while (true)
+    {
+        int socket = accept4(m_listenSocket, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (socket < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                std::cerr << "Error accepting image channel connection" << std::endl;
+            }
+            return;
+        }
+        std::cout << "socket connected successfully" << std::endl;
+        post({RequestType::Connect, socket, nullptr, 0});
+    }
+}
+
+void ImageReactor::takeRequests(Worker& worker)
+{
+    std::uint64_t wakeups;
+    read(worker.wakeFd, &wakeups, sizeof(wakeups));
+
+    std::vector<Request> requests;
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        requests.swap(worker.incoming);
+    }
+
+    for (auto& request : requests)
+    {
+        if (request.type == RequestType::Connect)
+        {
+            FrameHeader hello;
+            hello.type = FrameType::Hello;
+            if (std::shared_ptr<const ImageBlob> image = m_currentImage())
+            {
+                hello.compression = image->encoding();
+                hello.imageId = image->version();
+                hello.hash = image->hash();
+                hello.totalSize = image->size();
+            }
+            Connection connection {State::Greeting, EncodeFrameHeader(hello), 0, {nullptr, {}, 0, 0, {}}};
+            worker.connections.emplace(request.socket, std::move(connection));
+            epoll_event event {};
+            event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+            event.data.fd = request.socket;
+            if (epoll_ctl(worker.epollFd, EPOLL_CTL_ADD, request.socket, &event) < 0)
+            {
+                std::cerr << "Error watching socket:" << request.socket << std::endl;
+                worker.connections.erase(request.socket);
+                close(request.socket);
+            }
+        }
+        else
+        {
+            auto it = worker.connections.find(request.socket);
+            if (it == worker.connections.end())
+            {
+                std::cerr << "No image channel for socket:" << request.socket << std::endl;
+                continue;
+            }
+            Transfer& transfer = it->second.transfer;
+            if (transfer.image)
+            {
+                if (transfer.pending.size() >= REACTORPENDING)
+                {
+                    std::cerr << "Dropping the oldest image request queued for socket:" << request.socket << std::endl;
+                    transfer.pending.pop_front();
+                }
+                transfer.pending.push_back({std::move(request.image), request.offset});
+            }
+            else
+            {
+                startTransfer(transfer, std::move(request.image), request.offset);
+                advance(worker, request.socket);
+            }
+        }
+    }
+}
+
+void ImageReactor::advance(Worker& worker, int socket)
+{
+    auto it = worker.connections.find(socket);
+    if (it == worker.connections.end())
+    {
+        return;
+    }
+    if (!step(socket, it->second))
+    {
+        closeConnection(worker, socket);
+    }
+}
+
+void ImageReactor::closeConnection(Worker& worker, int socket)
+{
+    auto it = worker.connections.find(socket);
+    if (it == worker.connections.end())
+    {
+        return;
+    }
+
+    // Still open, so a new connection cannot get the same number before the handler forgets this one
+    if (it->second.state == State::Ready && m_onClose)
+    {
+        m_onClose(socket);
+    }
+    epoll_ctl(worker.epollFd, EPOLL_CTL_DEL, socket, nullptr);
+    worker.connections.erase(it);
+    close(socket);
+}
+
+bool ImageReactor::step(int socket, Connection& connection)
+{
+    while (connection.state == State::Greeting)
+    {
+        ssize_t bytesSent = send(socket, connection.greeting.data() + connection.greetingSent,
+                                 connection.greeting.size() - connection.greetingSent, MSG_NOSIGNAL);
+        if (bytesSent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return true;
+        }
+        if (bytesSent < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (bytesSent <= 0)
+        {
+            return false;
+        }
+        connection.greetingSent += bytesSent;
+        if (connection.greetingSent == connection.greeting.size())
+        {
+            connection.state = State::ReadingToken;
+        }
+    }
+
+    if (connection.state == State::ReadingToken)
+    {
+        std::array<char, HANDSHAKEBUF> buffer;
+        ssize_t bytesRead;
+        do
+        {
+            bytesRead = recv(socket, buffer.data(), buffer.size(), 0);
+        } while (bytesRead < 0 && errno == EINTR);
+        if (bytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return true;
+        }
+        if (bytesRead <= 0)
+        {
+            return false;
+        }
+        m_onToken(std::string(buffer.data(), bytesRead), socket);
+        connection.state = State::Ready;
+    }
+
+    return !connection.transfer.image || pump(socket, connection.transfer);
+}
+
+void ImageReactor::startTransfer(Transfer& transfer, std::shared_ptr<const ImageBlob> image, std::uint64_t offset)
+{
+    FrameHeader header;
+    header.compression = image->encoding();
+    header.imageId = image->version();
+    header.hash = image->hash();
+    header.totalSize = image->size();
+    header.offset = std::min<std::uint64_t>(offset, image->size());
+    header.length = header.totalSize - header.offset;
+    transfer.header = EncodeFrameHeader(header);
+    transfer.headerSent = 0;
+    transfer.offset = static_cast<off_t>(header.offset);
+    transfer.image = std::move(image);
+}
+
+bool ImageReactor::pump(int socket, Transfer& transfer)
+{
+    while (transfer.image)
+    {
+        auto size = static_cast<off_t>(transfer.image->size());
+        while (transfer.headerSent < transfer.header.size() || transfer.offset < size)
+        {
+            ssize_t bytesSent;
+            if (transfer.headerSent < transfer.header.size())
+            {
+                bytesSent = send(socket, transfer.header.data() + transfer.headerSent,
+                                 transfer.header.size() - transfer.headerSent, MSG_NOSIGNAL | MSG_MORE);
+                transfer.headerSent += bytesSent > 0 ? bytesSent : 0;
+            }
+            else if (transfer.image->fd() >= 0)
+            {
+                bytesSent = sendfile(socket, transfer.image->fd(), &transfer.offset, size - transfer.offset);
+            }
+            else
+            {
+                bytesSent =
+                    send(socket, transfer.image->data() + transfer.offset, size - transfer.offset, MSG_NOSIGNAL);
+                transfer.offset += bytesSent > 0 ? bytesSent : 0;
+            }
+            if (bytesSent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                return true;
+            }
+            if (bytesSent < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (bytesSent <= 0)
+            {
+                std::cerr << "Error sending image to socket:" << socket << std::endl;
+                return false;
+            }
+        }
+        std::cout << "Finished sending image version " << transfer.image->version() << " to socket:" << socket
+                  << std::endl;
+
+        transfer.image = nullptr;
+        if (!transfer.pending.empty())
+        {
+            QueuedImage next = std::move(transfer.pending.front());
+            transfer.pending.pop_front();
+            startTransfer(transfer, std::move(next.image), next.offset);
+        }
+    }
+    return true;
+}
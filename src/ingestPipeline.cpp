@@ -0,0 +1,290 @@
+/**
+ * @file ingestPipeline.cpp
+ * @brief Staged pipeline turning the images dropped in a directory into published edge maps
+ */
+
+#include "ingestPipeline.hpp"
+#include "cannyEdgeFilter.hpp"
+#include "changeDetector.hpp"
+#include "imageFileOperations.hpp"
+#include "variantCache.hpp"
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <poll.h>
+#include <stdexcept>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+IngestPipeline::IngestPipeline(Publisher publish, JobManager* jobs, std::size_t queueCapacity,
+                               std::size_t decodeWorkers, std::size_t encodeWorkers)
+    : m_publish(std::move(publish)), m_jobs(jobs), m_submitted(queueCapacity), m_decoded(queueCapacity),
+      m_detected(queueCapacity), m_sequence(0), m_lastPublished(0), m_stopFd(eventfd(0, EFD_CLOEXEC))
+{
+    if (m_stopFd < 0)
+    {
+        throw std::runtime_error("Error creating the pipeline stop event");
+    }
+    for (std::size_t i = 0; i < std::max<std::size_t>(1, decodeWorkers); ++i)
+    {
+        m_decoders.emplace_back(&IngestPipeline::decodeLoop, this);
+    }
+    m_detector = std::thread(&IngestPipeline::detectLoop, this);
+    for (std::size_t i = 0; i < std::max<std::size_t>(1, encodeWorkers); ++i)
+    {
+        m_encoders.emplace_back(&IngestPipeline::encodeLoop, this);
+    }
+}
+
+IngestPipeline::~IngestPipeline()
+{
+    stop();
+    close(m_stopFd);
+}
+
+void IngestPipeline::watch(const std::string& directory)
+{
+    std::lock_guard<std::mutex> lock(m_stopMutex);
+    if (m_watcher.joinable())
+    {
+        throw std::runtime_error("The pipeline is already watching a directory");
+    }
+    if (mkdir(directory.c_str(), 0755) < 0 && errno != EEXIST)
+    {
+        throw std::runtime_error("Error creating watch directory: " + directory);
+    }
+
+    int inotifyFd = inotify_init1(IN_CLOEXEC);
+    if (inotifyFd < 0 || inotify_add_watch(inotifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+        if (inotifyFd >= 0)
+        {
+            close(inotifyFd);
+        }
+        throw std::runtime_error("Error watching directory: " + directory);
+    }
+    m_watcher = std::thread(&IngestPipeline::watchLoop, this, inotifyFd, directory);
+}
+
+bool IngestPipeline::submit(const std::string& path)
+{
+    std::string job;
+    if (m_jobs != nullptr)
+    {
+        job = m_jobs->track();
+        std::lock_guard<std::mutex> lock(m_jobMutex);
+        m_lastJob = job;
+    }
+    Frame frame {++m_sequence, path, job, cv::Mat(), cv::Mat()};
+    if (!m_submitted.push(frame))
+    {
+        finish(frame, JobState::Failed, "The pipeline is stopped");
+        return false;
+    }
+    return true;
+}
+
+std::string IngestPipeline::lastJob() const
+{
+    std::lock_guard<std::mutex> lock(m_jobMutex);
+    return m_lastJob;
+}
+
+void IngestPipeline::stop()
+{
+    std::lock_guard<std::mutex> lock(m_stopMutex);
+    std::uint64_t one = 1;
+    if (write(m_stopFd, &one, sizeof(one)) < 0)
+    {
+        perror("Stopping the pipeline");
+    }
+
+    // Each stage is closed once the one feeding it has finished, so the frames in flight are published
+    m_submitted.close();
+    if (m_watcher.joinable())
+    {
+        m_watcher.join();
+    }
+    for (auto& decoder : m_decoders)
+    {
+        decoder.join();
+    }
+    m_decoders.clear();
+    m_decoded.close();
+    if (m_detector.joinable())
+    {
+        m_detector.join();
+    }
+    m_detected.close();
+    for (auto& encoder : m_encoders)
+    {
+        encoder.join();
+    }
+    m_encoders.clear();
+}
+
+void IngestPipeline::watchLoop(int inotifyFd, const std::string& directory)
+{
+    // Aligned for the inotify_event structures read into it
+    alignas(inotify_event) std::array<char, 4096> buffer;
+    std::array<pollfd, 2> fds {{{inotifyFd, POLLIN, 0}, {m_stopFd, POLLIN, 0}}};
+
+    while (true)
+    {
+        if (poll(fds.data(), fds.size(), -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            perror("Polling the watch directory");
+            break;
+        }
+        if (fds[1].revents != 0)
+        {
+            break;
+        }
+
+        ssize_t length = read(inotifyFd, buffer.data(), buffer.size());
+        if (length <= 0)
+        {
+            if (length < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            perror("Reading the watch directory events");
+            break;
+        }
+        for (ssize_t position = 0; position < length;)
+        {
+            auto event = reinterpret_cast<const inotify_event*>(buffer.data() + position);
+            position += sizeof(inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW)
+            {
+                std::cerr << "Watch directory events lost, some images were skipped" << std::endl;
+            }
+            if (event->len == 0 || event->name[0] == '.' || (event->mask & IN_ISDIR))
+            {
+                continue;
+            }
+            if (!submit(directory + "/" + event->name))
+            {
+                close(inotifyFd);
+                return;
+            }
+        }
+    }
+    close(inotifyFd);
+}
+
+void IngestPipeline::decodeLoop()
+{
+    ImageFileOperations imageFileOperations;
+    while (std::optional<Frame> frame = m_submitted.pop())
+    {
+        report(*frame, 0);
+        try
+        {
+            // Every frame is read once, keeping it in the decoded image cache would only evict useful entries
+            frame->image = imageFileOperations.decodeImage(frame->path);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Error decoding " << frame->path << ": " << e.what() << std::endl;
+            finish(*frame, JobState::Failed, e.what());
+            continue;
+        }
+        if (frame->image.empty())
+        {
+            finish(*frame, JobState::Failed, "The file is not a supported image");
+            continue;
+        }
+        report(*frame, JOBDECODEPROGRESS);
+        m_decoded.push(std::move(*frame));
+    }
+}
+
+void IngestPipeline::detectLoop()
+{
+    EdgeDetection edgeDetection(CANNYLOW, CANNYHIGH, CANNYSIGMA);
+    edgeDetection.setSaveStages(false);
+    ChangeDetector changeDetector;
+
+    while (std::optional<Frame> frame = m_decoded.pop())
+    {
+        edgeDetection.setProgressCallback([this, &frame](int percent) {
+            report(*frame, JOBDECODEPROGRESS + percent * JOBCANNYPROGRESS / PROGRESS_DONE);
+        });
+        try
+        {
+            auto start = std::chrono::steady_clock::now();
+            const ChangeDetectionResult& result = changeDetector.process(edgeDetection, frame->image);
+            auto elapsed =
+                std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+            std::cout << "Canny process time of " << frame->path << ": " << elapsed.count() << "us ("
+                      << (result.fullRecompute ? "full frame" : std::to_string(result.changed.size()) + " regions")
+                      << ")" << std::endl;
+
+            // The result is overwritten by the next frame, the encoders get their own copy
+            frame->edges = result.edges.clone();
+            frame->image.release();
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Error detecting edges of " << frame->path << ": " << e.what() << std::endl;
+            finish(*frame, JobState::Failed, e.what());
+            continue;
+        }
+        m_detected.push(std::move(*frame));
+    }
+}
+
+void IngestPipeline::encodeLoop()
+{
+    while (std::optional<Frame> frame = m_detected.pop())
+    {
+        try
+        {
+            std::vector<char> data = EncodeEdgeMap(frame->edges);
+            std::lock_guard<std::mutex> lock(m_publishMutex);
+            if (frame->sequence < m_lastPublished)
+            {
+                finish(*frame, JobState::Failed, "Superseded by a newer image");
+                continue;
+            }
+            m_lastPublished = frame->sequence;
+            m_publish(frame->edges, std::move(data));
+            finish(*frame, JobState::Done);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Error publishing " << frame->path << ": " << e.what() << std::endl;
+            finish(*frame, JobState::Failed, e.what());
+        }
+    }
+}
+
+void IngestPipeline::report(const Frame& frame, int progress)
+{
+    if (m_jobs != nullptr)
+    {
+        m_jobs->update(frame.job, JobState::Running, progress);
+    }
+}
+
+void IngestPipeline::finish(const Frame& frame, JobState state, const std::string& error)
+{
+    if (m_jobs != nullptr)
+    {
+        JobStatus status;
+        status.state = state;
+        status.progress = state == JobState::Done ? PROGRESS_DONE : 0;
+        status.error = error;
+        m_jobs->finish(frame.job, std::move(status));
+    }
+}
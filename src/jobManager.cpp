@@ -0,0 +1,325 @@
+/**
+ * @file jobManager.cpp
+ * @brief Prioritized queue of the edge detection jobs uploaded by the clients
+ */
+
+#include "jobManager.hpp"
+#include "variantCache.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <iomanip>
+#include <iterator>
+#include <opencv2/imgcodecs.hpp>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+std::uint32_t BigEndian(const unsigned char* data, std::size_t width)
+{
+    std::uint32_t value = 0;
+    for (std::size_t i = 0; i < width; ++i)
+    {
+        value = (value << 8) | data[i];
+    }
+    return value;
+}
+
+/**
+ * @brief Reads the size of a PNG or JPEG image from its header, without decoding it.
+ *
+ * @return False for other formats and malformed headers.
+ */
+bool PeekImageSize(const std::vector<char>& image, std::uint64_t& rows, std::uint64_t& cols)
+{
+    const auto* data = reinterpret_cast<const unsigned char*>(image.data());
+    const std::size_t size = image.size();
+    static const unsigned char png[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    if (size >= 24 && std::equal(std::begin(png), std::end(png), data))
+    {
+        // The IHDR chunk comes first: length, type, then the width and the height
+        cols = BigEndian(data + 16, 4);
+        rows = BigEndian(data + 20, 4);
+        return true;
+    }
+    if (size < 4 || data[0] != 0xff || data[1] != 0xd8)
+    {
+        return false;
+    }
+
+    // Walk the JPEG segments up to the start of frame, which holds the height and the width
+    std::size_t position = 2;
+    while (position + 4 <= size)
+    {
+        if (data[position] != 0xff)
+        {
+            return false;
+        }
+        const unsigned char marker = data[position + 1];
+        if (marker == 0xff)
+        {
+            ++position;
+            continue;
+        }
+        if (marker == 0x01 || (marker >= 0xd0 && marker <= 0xd9))
+        {
+            position += 2;
+            continue;
+        }
+        if (marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc)
+        {
+            if (position + 9 > size)
+            {
+                return false;
+            }
+            rows = BigEndian(data + position + 5, 2);
+            cols = BigEndian(data + position + 7, 2);
+            return true;
+        }
+        position += 2 + BigEndian(data + position + 2, 2);
+    }
+    return false;
+}
+} // namespace
+
+const char* JobStateName(JobState state)
+{
+    switch (state)
+    {
+    case JobState::Queued:
+        return "queued";
+    case JobState::Running:
+        return "running";
+    case JobState::Done:
+        return "done";
+    default:
+        return "failed";
+    }
+}
+
+JobManager::JobManager(std::size_t workers, std::size_t queueLimit, std::size_t retention, ResultCache* results)
+    : m_queueLimit(queueLimit), m_retention(retention), m_results(results), m_sequence(0),
+      m_idGenerator(std::random_device {}()), m_stopping(false)
+{
+    for (std::size_t i = 0; i < std::max<std::size_t>(1, workers); ++i)
+    {
+        m_workers.emplace_back(&JobManager::workerLoop, this);
+    }
+}
+
+JobManager::~JobManager()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_jobQueued.notify_all();
+    for (auto& worker : m_workers)
+    {
+        worker.join();
+    }
+}
+
+std::optional<std::string> JobManager::submit(std::vector<char>&& image, int priority,
+                                              const CannyParameters& parameters)
+{
+    ResultKey key = ResultKey::of(image.data(), image.size(), parameters);
+    if (std::shared_ptr<const ImageBlob> cached = m_results != nullptr ? m_results->get(key) : nullptr)
+    {
+        std::string id = track();
+        JobStatus status;
+        status.state = JobState::Done;
+        status.progress = PROGRESS_DONE;
+        status.result = std::move(cached);
+        finish(id, std::move(status));
+        return id;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_queue.size() >= m_queueLimit)
+    {
+        return std::nullopt;
+    }
+
+    std::string id = newId();
+    m_queue.push_back({id, std::clamp(priority, 0, JOBMAXPRIORITY), ++m_sequence, std::move(image), key});
+    std::push_heap(m_queue.begin(), m_queue.end(), runsAfter);
+    m_status[id] = JobStatus();
+    lock.unlock();
+    m_jobQueued.notify_one();
+    return id;
+}
+
+std::optional<JobStatus> JobManager::status(const std::string& id) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_status.find(id);
+    if (it == m_status.end())
+    {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+std::optional<JobStatus> JobManager::wait(const std::string& id, std::chrono::milliseconds timeout,
+                                          std::optional<int> progress) const
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_jobChanged.wait_for(lock, timeout, [&] {
+        auto it = m_status.find(id);
+        return it == m_status.end() || it->second.state == JobState::Done || it->second.state == JobState::Failed ||
+               (progress.has_value() && it->second.progress != progress.value());
+    });
+    auto it = m_status.find(id);
+    if (it == m_status.end())
+    {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+std::string JobManager::track()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::string id = newId();
+    m_status[id] = JobStatus();
+    return id;
+}
+
+void JobManager::update(const std::string& id, JobState state, int progress)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_status.find(id);
+        if (it == m_status.end())
+        {
+            return;
+        }
+        it->second.state = state;
+        it->second.progress = progress;
+    }
+    m_jobChanged.notify_all();
+}
+
+std::string JobManager::newId()
+{
+    std::ostringstream id;
+    id << std::hex << std::setw(16) << std::setfill('0') << m_idGenerator();
+    return id.str();
+}
+
+bool JobManager::runsAfter(const Job& first, const Job& second)
+{
+    return first.priority != second.priority ? first.priority < second.priority : first.sequence > second.sequence;
+}
+
+void JobManager::workerLoop()
+{
+    // Linux applies the nice value per thread, and the OpenMP team of this thread inherits it
+    if (setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), JOBNICE) < 0)
+    {
+        perror("Lowering the job thread priority");
+    }
+    EdgeDetection edgeDetection(CANNYLOW, CANNYHIGH, CANNYSIGMA);
+    edgeDetection.setSaveStages(false);
+
+    while (true)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_jobQueued.wait(lock, [this] { return m_stopping || !m_queue.empty(); });
+        if (m_stopping)
+        {
+            return;
+        }
+        std::pop_heap(m_queue.begin(), m_queue.end(), runsAfter);
+        Job job = std::move(m_queue.back());
+        m_queue.pop_back();
+        m_status[job.id].state = JobState::Running;
+        lock.unlock();
+        m_jobChanged.notify_all();
+
+        JobStatus status;
+        try
+        {
+            status.result = process(job, edgeDetection);
+            status.state = JobState::Done;
+            status.progress = PROGRESS_DONE;
+        }
+        catch (const std::exception& e)
+        {
+            status.state = JobState::Failed;
+            status.error = e.what();
+        }
+        finish(job.id, std::move(status));
+    }
+}
+
+void JobManager::finish(const std::string& id, JobStatus&& status)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_status.find(id) == m_status.end())
+        {
+            return;
+        }
+        m_status[id] = std::move(status);
+        m_finished.push_back(id);
+        while (m_finished.size() > m_retention)
+        {
+            m_status.erase(m_finished.front());
+            m_finished.pop_front();
+        }
+    }
+    m_jobChanged.notify_all();
+}
+
+std::shared_ptr<const ImageBlob> JobManager::process(const Job& job, EdgeDetection& edgeDetection)
+{
+    if (std::shared_ptr<const ImageBlob> cached = m_results != nullptr ? m_results->get(job.key) : nullptr)
+    {
+        return cached;
+    }
+
+    // A small upload can claim a huge image, so the size is checked before the planes of the decode are allocated
+    std::uint64_t rows = 0;
+    std::uint64_t cols = 0;
+    if (PeekImageSize(job.image, rows, cols) && rows * cols > UPLOADMAXPIXELS)
+    {
+        throw std::runtime_error("The upload is too large: " + std::to_string(cols) + "x" + std::to_string(rows) +
+                                 " pixels, at most " + std::to_string(UPLOADMAXPIXELS) + " are accepted");
+    }
+
+    cv::Mat encoded(1, static_cast<int>(job.image.size()), CV_8UC1, const_cast<char*>(job.image.data()));
+    cv::Mat decoded = cv::imdecode(encoded, cv::IMREAD_GRAYSCALE);
+    if (decoded.empty())
+    {
+        throw std::runtime_error("The upload is not a supported image");
+    }
+    if (decoded.total() > UPLOADMAXPIXELS)
+    {
+        throw std::runtime_error("The upload is too large: " + std::to_string(decoded.cols) + "x" +
+                                 std::to_string(decoded.rows) + " pixels, at most " +
+                                 std::to_string(UPLOADMAXPIXELS) + " are accepted");
+    }
+    update(job.id, JobState::Running, JOBDECODEPROGRESS);
+
+    edgeDetection.setThresholds(job.key.parameters.low, job.key.parameters.high);
+    edgeDetection.setSigma(job.key.parameters.sigma);
+    edgeDetection.setProgressCallback([this, &job](int percent) {
+        update(job.id, JobState::Running, JOBDECODEPROGRESS + percent * JOBCANNYPROGRESS / PROGRESS_DONE);
+    });
+    std::vector<char> edges = EncodeEdgeMap(edgeDetection.detectEdges(decoded));
+    edgeDetection.setProgressCallback(nullptr);
+
+    auto result = std::make_shared<const ImageBlob>(std::move(edges), 0, FrameCompression::EdgeMap, false);
+    if (m_results != nullptr)
+    {
+        m_results->put(job.key, result);
+    }
+    return result;
+}
@@ -0,0 +1,87 @@
+/**
+ * @file resultCache.cpp
+ * @brief Cache of the edge maps computed for an image and a set of Canny parameters
+ */
+
+#include "resultCache.hpp"
+#include "contentHash.hpp"
+#include "rocksDbWrapper.hpp"
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+bool CannyParameters::valid() const
+{
+    return low > 0 && low <= high && sigma > 0 && sigma <= CANNYMAXSIGMA;
+}
+
+ResultKey ResultKey::of(const char* data, std::size_t size, const CannyParameters& parameters)
+{
+    return {ContentHash(data, size), size, parameters};
+}
+
+std::string ResultKey::str() const
+{
+    std::ostringstream key;
+    key << std::hex << std::setw(16) << std::setfill('0') << hash << "-" << size << "-" << std::hexfloat
+        << parameters.low << "-" << parameters.high << "-" << parameters.sigma;
+    return key.str();
+}
+
+ResultCache::ResultCache(std::size_t budget, RocksDbWrapper* store)
+    : m_memory(budget), m_store(store), m_memoryHits(0), m_storeHits(0), m_misses(0)
+{
+}
+
+std::shared_ptr<const ImageBlob> ResultCache::get(const ResultKey& key)
+{
+    const std::string id = key.str();
+    if (std::optional<std::shared_ptr<const ImageBlob>> cached = m_memory.get(id))
+    {
+        ++m_memoryHits;
+        return *cached;
+    }
+
+    std::string stored;
+    try
+    {
+        if (m_store != nullptr && m_store->get(RESULTPREFIX + id, stored))
+        {
+            auto result = std::make_shared<const ImageBlob>(std::vector<char>(stored.begin(), stored.end()), 0,
+                                                            FrameCompression::EdgeMap, false);
+            m_memory.put(id, result, result->size());
+            ++m_storeHits;
+            return result;
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error reading the result cache: " << e.what() << std::endl;
+    }
+    ++m_misses;
+    return nullptr;
+}
+
+void ResultCache::put(const ResultKey& key, const std::shared_ptr<const ImageBlob>& result)
+{
+    const std::string id = key.str();
+    m_memory.put(id, result, result->size());
+    try
+    {
+        if (m_store != nullptr)
+        {
+            m_store->put(RESULTPREFIX + id, rocksdb::Slice(result->data(), result->size()));
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error writing the result cache: " << e.what() << std::endl;
+    }
+}
+
+ResultCacheStats ResultCache::stats() const
+{
+    return {m_memoryHits.load(), m_storeHits.load(), m_misses.load(), m_memory.bytes()};
+}
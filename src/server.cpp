@@ -24,7 +24,16 @@ void LogActivity(const std::string& activity, std::mutex& LogMutex, const std::s
     LogFile << "\n";
 }
 
-Server::Server() : fileReadComplete(false), db(DBPATH)
+Server::Server()
+    : fileReadComplete(false), db(DBPATH), imageVersion(0),
+      imageReactor([this] { return currentImage(); },
+                   [this](const std::string& token, int socket) { SetTokenSocket(token, socket); },
+                   [this](int socket) { ReleaseTokenSocket(socket); }),
+      resultDb(RESULTDBPATH, RESULTSTOREBUDGET), resultCache(RESULTBUDGET, &resultDb),
+      jobManager(JOBWORKERS, JOBQUEUELIMIT, JOBRETENTION, &resultCache),
+      pipeline([this](const cv::Mat& edges, std::vector<char>&& data) { publishImage(edges, std::move(data)); },
+               &jobManager),
+      jobWaiters(0)
 {
     std::unordered_map<std::string, int> foodItems = {
         {"meat", 100}, {"vegetables", 200}, {"fruits", 150}, {"water", 1000}};
@@ -70,36 +79,6 @@ std::string Server::GenerateToken()
     return token;
 }
 
-void Server::ProcessImageRequests()
-{
-    while (true)
-    {
-        std::unique_lock<std::mutex> lock(queueMutex);
-        queueCondition.wait(lock, [this] { return !imageRequestQueue.empty(); });
-
-        while (!imageRequestQueue.empty())
-        {
-            auto request = imageRequestQueue.front();
-            imageRequestQueue.pop();
-            lock.unlock();
-
-            int clientSocket = request.first;
-            std::string token = request.second;
-
-            try
-            {
-                SendChunksTCPv6(*this, clientSocket, chunks);
-            }
-            catch (const std::exception& e)
-            {
-                std::cerr << "Error processing image request: " << e.what() << std::endl;
-            }
-
-            lock.lock();
-        }
-    }
-}
-
 bool Server::HandleModifyCommand(const std::string& command)
 {
     std::istringstream iss(command);
@@ -183,17 +162,32 @@ void Server::HandleCommand(const httplib::Request& req, httplib::Response& res,
         {
             std::string username = optUsername.value();
             std::optional<int> clientSocketOpt = GetUserSocket(token);
-            if (clientSocketOpt.has_value())
+            std::shared_ptr<const ImageBlob> image = currentImage();
+            std::uint64_t offset = 0;
+            if (req.has_param("hash") && req.has_param("offset"))
             {
-                int clientSocket = clientSocketOpt.value();
-
+                try
+                {
+                    if (std::stoull(req.get_param_value("hash")) == image->hash())
+                    {
+                        offset = std::min<std::uint64_t>(std::stoull(req.get_param_value("offset")), image->size());
+                    }
+                }
+                catch (const std::exception& e)
                 {
-                    std::lock_guard<std::mutex> lock(queueMutex);
-                    imageRequestQueue.emplace(clientSocket, token);
+                    offset = 0;
                 }
-                queueCondition.notify_one();
+            }
 
-                res.set_content("Sending image...", "text/plain");
+            if (offset == image->size())
+            {
+                res.set_content("Image up to date", "text/plain");
+            }
+            else if (clientSocketOpt.has_value())
+            {
+                // The reactor thread owning the channel sends it, this handler does not wait for the transfer
+                imageReactor.enqueue(clientSocketOpt.value(), image, offset);
+                res.set_content(offset > 0 ? "Resuming image..." : "Sending image...", "text/plain");
                 LogActivity("Image request made by the client ", LogMutex, optUsername.value());
             }
             else
@@ -203,7 +197,7 @@ void Server::HandleCommand(const httplib::Request& req, httplib::Response& res,
         }
         else
         {
-            res.set_content("Loading image. Try again later", "text/plain");
+            res.set_content("Processing image,job:" + pipeline.lastJob(), "text/plain");
         }
     }
     else if (HandleModifyCommand(message))
@@ -278,6 +272,226 @@ void Server::HandleAlertsCommand(const httplib::Request& req, httplib::Response&
     }
 }
 
+void Server::HandleImageRequest(const httplib::Request& req, httplib::Response& res)
+{
+    std::shared_ptr<const ImageBlob> image = currentImage();
+    if (!image)
+    {
+        res.status = 503;
+        res.set_header("Retry-After", "1");
+        std::string job = pipeline.lastJob();
+        if (!job.empty())
+        {
+            res.set_header("Location", "/jobs/" + job);
+        }
+        res.set_content("Loading image. Try again later", "text/plain");
+        return;
+    }
+
+    ServeImage(req, res, std::move(image), variantCache);
+}
+
+void Server::HandleUploadRequest(const httplib::Request& req, httplib::Response& res,
+                                 const httplib::ContentReader& reader, std::mutex& LogMutex)
+{
+    std::string token = req.get_param_value("token");
+    std::optional<std::string> optUsername = userManager.GetUserFromToken(token);
+    if (!optUsername.has_value())
+    {
+        res.status = 401;
+        res.set_content("Unknown token", "text/plain");
+        return;
+    }
+
+    std::vector<char> image;
+    bool tooLarge = false;
+    auto append = [&](const char* data, std::size_t length) {
+        if (image.size() + length > UPLOADMAXSIZE)
+        {
+            tooLarge = true;
+            return false;
+        }
+        image.insert(image.end(), data, data + length);
+        return true;
+    };
+    if (req.is_multipart_form_data())
+    {
+        bool imageField = false;
+        reader(
+            [&](const httplib::MultipartFormData& field) {
+                imageField = field.name == "image";
+                return true;
+            },
+            [&](const char* data, std::size_t length) { return !imageField || append(data, length); });
+    }
+    else
+    {
+        reader(append);
+    }
+    if (tooLarge || image.empty())
+    {
+        res.status = tooLarge ? 413 : 400;
+        res.set_content(tooLarge ? "Image too large" : "No image uploaded", "text/plain");
+        return;
+    }
+
+    int priority = 0;
+    if (req.has_param("priority") && userManager.IsUserAuthorized(token).value_or(false))
+    {
+        try
+        {
+            priority = std::stoi(req.get_param_value("priority"));
+        }
+        catch (const std::exception& e)
+        {
+            priority = 0;
+        }
+    }
+    CannyParameters parameters;
+    bool parsed = true;
+    try
+    {
+        parameters.low = req.has_param("low") ? std::stof(req.get_param_value("low")) : parameters.low;
+        parameters.high = req.has_param("high") ? std::stof(req.get_param_value("high")) : parameters.high;
+        parameters.sigma = req.has_param("sigma") ? std::stof(req.get_param_value("sigma")) : parameters.sigma;
+    }
+    catch (const std::exception& e)
+    {
+        parsed = false;
+    }
+    if (!parsed || !parameters.valid())
+    {
+        res.status = 400;
+        res.set_content("Bad Canny parameters", "text/plain");
+        return;
+    }
+
+    std::optional<std::string> jobId = jobManager.submit(std::move(image), priority, parameters);
+    if (!jobId.has_value())
+    {
+        res.status = 503;
+        res.set_header("Retry-After", "5");
+        res.set_content("Too many jobs. Try again later", "text/plain");
+        return;
+    }
+
+    nlohmann::json job;
+    job["id"] = jobId.value();
+    job["state"] = JobStateName(jobManager.status(jobId.value()).value_or(JobStatus()).state);
+    res.status = 202;
+    res.set_header("Location", "/jobs/" + jobId.value());
+    res.set_content(job.dump(), "application/json");
+    LogActivity("Image uploaded by the client ", LogMutex, optUsername.value());
+}
+
+void Server::HandleJobRequest(const httplib::Request& req, httplib::Response& res)
+{
+    std::string id = req.matches[1];
+    int wait = 0;
+    std::optional<int> progress;
+    try
+    {
+        wait = req.has_param("wait") ? std::clamp(std::stoi(req.get_param_value("wait")), 0, JOBMAXWAIT) : 0;
+        if (req.has_param("progress"))
+        {
+            progress = std::stoi(req.get_param_value("progress"));
+        }
+    }
+    catch (const std::exception& e)
+    {
+        res.status = 400;
+        res.set_content("Bad wait or progress", "text/plain");
+        return;
+    }
+
+    // Each long-poll holds an HTTP thread, past the limit the state is returned right away
+    std::optional<JobStatus> status;
+    if (wait > 0 && ++jobWaiters <= JOBMAXWAITERS)
+    {
+        status = jobManager.wait(id, std::chrono::seconds(wait), progress);
+        --jobWaiters;
+    }
+    else
+    {
+        if (wait > 0)
+        {
+            --jobWaiters;
+        }
+        status = jobManager.status(id);
+    }
+    if (!status.has_value())
+    {
+        res.status = 404;
+        res.set_content("Unknown job", "text/plain");
+        return;
+    }
+
+    if (req.matches[2].length() == 0)
+    {
+        nlohmann::json job;
+        job["id"] = id;
+        job["state"] = JobStateName(status->state);
+        job["progress"] = status->progress;
+        if (status->state == JobState::Failed)
+        {
+            job["error"] = status->error;
+        }
+        res.set_content(job.dump(), "application/json");
+    }
+    else if (status->state == JobState::Done && !status->result)
+    {
+        res.set_redirect("/image", 303);
+    }
+    else if (status->state == JobState::Done)
+    {
+        std::shared_ptr<const ImageBlob> result = status->result;
+        res.set_content_provider(result->size(), EDGEMAPCONTENTTYPE,
+                                 [result](std::size_t offset, std::size_t length, httplib::DataSink& sink) {
+                                     return sink.write(result->data() + offset, length);
+                                 });
+    }
+    else if (status->state == JobState::Failed)
+    {
+        res.status = 422;
+        res.set_content(status->error, "text/plain");
+    }
+    else
+    {
+        res.status = 202;
+        res.set_header("Retry-After", "1");
+        res.set_content(JobStateName(status->state), "text/plain");
+    }
+}
+
+void Server::HandleMetricsRequest(const httplib::Request& req, httplib::Response& res)
+{
+    ResultCacheStats stats = resultCache.stats();
+    nlohmann::json metrics;
+    metrics["result_cache"]["memory_hits"] = stats.memoryHits;
+    metrics["result_cache"]["store_hits"] = stats.storeHits;
+    metrics["result_cache"]["misses"] = stats.misses;
+    metrics["result_cache"]["bytes"] = stats.bytes;
+    res.set_content(metrics.dump(), "application/json");
+}
+
+void Server::HandleDensityRequest(const httplib::Request& req, httplib::Response& res)
+{
+    std::string summary;
+    bool found = false;
+    {
+        std::lock_guard<std::mutex> lock(DbMutex);
+        found = db.get(DENSITYKEY, summary);
+    }
+    if (!found)
+    {
+        res.status = 503;
+        res.set_header("Retry-After", "1");
+        res.set_content("Loading image. Try again later", "text/plain");
+        return;
+    }
+    res.set_content(summary, "application/json");
+}
+
 void Server::HandlePostRequest(const httplib::Request& req, httplib::Response& res, std::mutex& LogMutex)
 {
     std::string command = req.get_param_value("command");
@@ -321,11 +535,59 @@ void Server::SetTokenSocket(const std::string& token, int socket)
     userManager.UpdateTokenSocket(token, socket);
 }
 
+void Server::ReleaseTokenSocket(int socket)
+{
+    userManager.ReleaseSocket(socket);
+}
+
 std::optional<int> Server::GetUserSocket(const std::string& token)
 {
     return userManager.GetSocketFromToken(token);
 }
 
+void Server::publishImage(const cv::Mat& edges, std::vector<char>&& data)
+{
+    std::uint64_t version = ++imageVersion;
+    variantCache.setSource(version, edges);
+    try
+    {
+        cv::Mat continuous = edges.isContinuous() ? edges : edges.clone();
+        EdgeDensity density = ComputeEdgeDensity(continuous.ptr<std::uint8_t>(), continuous.rows, continuous.cols);
+        density.version = version;
+        const std::string summary = density.toJson();
+        std::lock_guard<std::mutex> lock(DbMutex);
+        db.put(DENSITYKEY, summary);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error storing the edge density: " << e.what() << std::endl;
+    }
+    image.store(std::make_shared<const ImageBlob>(std::move(data), version, FrameCompression::EdgeMap));
+    notifyFileReadComplete();
+}
+
+void Server::startIngestion(const std::string& imagePath, const std::string& directory)
+{
+    pipeline.submit(imagePath);
+    pipeline.watch(directory);
+}
+
+void Server::stopIngestion()
+{
+    pipeline.stop();
+}
+
+std::shared_ptr<const ImageBlob> Server::currentImage() const
+{
+    return image.load();
+}
+
+void Server::listenImageChannel(std::unique_ptr<TCPv6Connection> listener)
+{
+    imageListener = std::move(listener);
+    imageReactor.listen(imageListener->getSocket());
+}
+
 void Server::notifyFileReadComplete()
 {
     std::lock_guard<std::mutex> lock(ImgFlagMutex);
@@ -361,6 +623,21 @@ void RunTempAlert(Server& server, std::mutex& LogMutex)
                 }
             }
             ModifyAlertsAndEmergencies(server, entry, "1");
+
+            std::string summary;
+            bool found = false;
+            {
+                std::lock_guard<std::mutex> lock(server.DbMutex);
+                found = server.db.get(DENSITYKEY, summary);
+            }
+            if (found)
+            {
+                nlohmann::json density = nlohmann::json::parse(summary, nullptr, false);
+                if (density.is_object() && density["zones"].contains(entry))
+                {
+                    LogActivity("Edge density at " + entry + ": " + density["zones"][entry].dump(), LogMutex);
+                }
+            }
         }
     }
 }
@@ -390,117 +667,6 @@ void SignalHandlerFunction(int SigNum)
     exit(0);
 }
 
-void compressImage(const std::string& inputPath, const std::string& outputPath)
-{
-    std::cout << "starting to compress the image" << std::endl;
-
-    std::string command = "tar -czvf " + outputPath + " -C " + inputPath.substr(0, inputPath.find_last_of("/")) + " " +
-                          inputPath.substr(inputPath.find_last_of("/") + 1);
-    int result = system(command.c_str());
-
-    if (result != 0)
-    {
-        throw std::runtime_error("Error compressing image with tar.gz");
-    }
-
-    std::cout << "finish to compress the image" << std::endl;
-}
-
-std::vector<std::vector<char>> readInChunks(const std::string& filePath, std::size_t chunkSize)
-{
-    std::cout << "starting file reading" << std::endl;
-    std::ifstream file(filePath, std::ios::binary);
-    if (!file)
-    {
-        throw std::runtime_error("Error opening file: " + filePath);
-    }
-
-    std::vector<std::vector<char>> chunks;
-
-    while (!file.eof())
-    {
-        std::vector<char> chunk(chunkSize);
-        file.read(chunk.data(), chunkSize);
-
-        if (file.gcount() < chunkSize)
-        {
-            chunk.resize(file.gcount());
-        }
-
-        chunks.push_back(chunk);
-    }
-    std::cout << "finish file reading" << std::endl;
-    return chunks;
-}
-
-void SendChunksTCPv6(Server& server, int socket, const std::vector<std::vector<char>>& chunks)
-{
-    int NumBytes;
-    std::array<char, BUFSIZESERVER> buffer;
-    std::stringstream ss;
-
-    std::ifstream file(COMPPATH, std::ios::binary | std::ios::ate);
-    std::streamsize sizeCompressedImage = file.tellg();
-    file.close();
-
-    server.waitForFileReadComplete();
-
-    if (chunks.empty())
-    {
-        std::cerr << "Error: Chunks are empty" << std::endl;
-        return;
-    }
-    std::streamsize bytesSentTotal = 0;
-    for (const auto& chunk : chunks)
-    {
-        size_t TotalSent = 0;
-        size_t ChunkSize = chunk.size();
-        while (TotalSent < ChunkSize)
-        {
-            ssize_t bytesSent = send(socket, chunk.data() + TotalSent, ChunkSize - TotalSent, 0);
-            if (bytesSent < 0)
-            {
-                throw std::runtime_error("Error sending data through the socket");
-            }
-            TotalSent += bytesSent;
-            bytesSentTotal += bytesSent;
-
-            if (bytesSentTotal >= sizeCompressedImage)
-            {
-                break;
-            }
-        }
-        if (bytesSentTotal >= sizeCompressedImage)
-        {
-            break;
-        }
-    }
-    std::cout << "Finished sending chunks to socket:" << socket << std::endl;
-}
-
-void SocketUsername(Server& server, int clientSocket)
-{
-    int NumBytes;
-    std::stringstream ss;
-    std::array<char, BUFSIZESERVER> buffer;
-    std::ifstream file(COMPPATH, std::ios::binary | std::ios::ate);
-    std::streamsize sizeCompressedImage = file.tellg();
-    file.close();
-    NumBytes = send(clientSocket, &sizeCompressedImage, sizeof(sizeCompressedImage), 0);
-    if (NumBytes < 0)
-    {
-        throw std::runtime_error("Error writing to socket.");
-    }
-    std::fill(buffer.begin(), buffer.end(), 0);
-    NumBytes = read(clientSocket, buffer.data(), BUFSIZESERVER);
-    if (NumBytes < 0)
-    {
-        throw std::runtime_error("Error reading from socket.");
-    }
-    std::string receivedMessage(buffer.data(), NumBytes);
-    server.SetTokenSocket(buffer.data(), clientSocket);
-}
-
 void ConnectToTCPv6Client(Server& server)
 {
     try
@@ -509,23 +675,7 @@ void ConnectToTCPv6Client(Server& server)
         auto TCPv6Client = std::make_unique<TCPv6Connection>("", port, true);
         if (TCPv6Client->bind())
         {
-            while (true)
-            {
-                try
-                {
-                    int clientSocket = TCPv6Client->connect();
-                    if (clientSocket != -1)
-                    {
-                        std::cout << "socket connected successfully" << std::endl;
-                        std::thread ClientThread(SocketUsername, std::ref(server), clientSocket);
-                        ClientThread.detach();
-                    }
-                }
-                catch (const std::exception& e)
-                {
-                    std::cerr << "Error in connect: " << e.what() << std::endl;
-                }
-            }
+            server.listenImageChannel(std::move(TCPv6Client));
         }
         else
         {
@@ -563,26 +713,6 @@ void Timer::Stop()
     mStopped = true;
 }
 
-void CannyCompressAndRead(Server& server, std::size_t chunkSize)
-{
-    Timer timer;
-    EdgeDetection edgeDetection(40.0, 80.0, 1.0);
-    edgeDetection.cannyEdgeDetection(IMAGEPATH, DESTIMAGE);
-    timer.Stop();
-    std::cout << "Finished Canny Edge Detection" << std::endl;
-    try
-    {
-        compressImage(DESTIMAGE, COMPPATH);
-        server.chunks = readInChunks(COMPPATH, chunkSize);
-
-        server.notifyFileReadComplete();
-    }
-    catch (const std::exception& e)
-    {
-        std::cerr << "Error: " << e.what() << std::endl;
-    }
-}
-
 int ReadPortFromThirdLine(const std::string& filename)
 {
     std::ifstream file(filename);
@@ -649,17 +779,23 @@ int main(int argc, char* argv[])
     int port = ReadPortFromFile(CONFPATH);
     std::mutex LogMutex;
     Server server;
-    std::size_t chunkSize = CHUNKSIZE * CHUNKSIZE;
 
-    std::thread compressionThread(CannyCompressAndRead, std::ref(server), chunkSize);
+    try
+    {
+        server.startIngestion(IMAGEPATH, WATCHDIR);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << std::endl;
+    }
     std::ofstream LogFile(LOGPATH);
     signal(SIGINT, &SignalHandlerFunction);
+    signal(SIGPIPE, SIG_IGN);
 
     std::thread AlertInvThread(RunTempAlert, std::ref(server), std::ref(LogMutex));
     std::thread EmergNotifThread(RunEmergNotif, std::ref(server), std::ref(LogMutex));
 
-    std::thread tcpv6Thread(ConnectToTCPv6Client, std::ref(server));
-    std::thread imageWorkerThread(&Server::ProcessImageRequests, &server);
+    ConnectToTCPv6Client(server);
 
     httplib::Server svr;
     svr.Post("/", [&](const httplib::Request& req, httplib::Response& res) {
@@ -671,9 +807,21 @@ int main(int argc, char* argv[])
     svr.Get("/alerts", [&](const httplib::Request& req, httplib::Response& res) {
         server.HandleAlertsCommand(req, res, LogMutex);
     });
+    svr.Get("/image",
+            [&](const httplib::Request& req, httplib::Response& res) { server.HandleImageRequest(req, res); });
+    svr.Post("/upload",
+             [&](const httplib::Request& req, httplib::Response& res, const httplib::ContentReader& reader) {
+                 server.HandleUploadRequest(req, res, reader, LogMutex);
+             });
+    svr.Get(R"(/jobs/([0-9a-f]+)(/result)?)",
+            [&](const httplib::Request& req, httplib::Response& res) { server.HandleJobRequest(req, res); });
+    svr.Get("/metrics",
+            [&](const httplib::Request& req, httplib::Response& res) { server.HandleMetricsRequest(req, res); });
+    svr.Get("/density",
+            [&](const httplib::Request& req, httplib::Response& res) { server.HandleDensityRequest(req, res); });
     svr.listen("0.0.0.0", port);
 
-    compressionThread.join();
+    server.stopIngestion();
     AlertInvThread.join();
     EmergNotifThread.join();
 
@@ -0,0 +1,236 @@
+/**
+ * @file variantCache.cpp
+ * @brief Cache of the resized and re-encoded variants of the published edge map
+ */
+
+#include "variantCache.hpp"
+#include "edgeSegments.hpp"
+#include "imageCompression.hpp"
+#include <algorithm>
+#include <nlohmann/json.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <stdexcept>
+
+std::string VariantKey::str() const
+{
+    return std::to_string(version) + "/" + std::to_string(width) + "/" + std::to_string(static_cast<int>(format)) +
+           "/" + std::to_string(level);
+}
+
+bool ParseVariantFormat(const std::string& name, VariantFormat& format)
+{
+    if (name == "png")
+    {
+        format = VariantFormat::Png;
+    }
+    else if (name == "webp")
+    {
+        format = VariantFormat::Webp;
+    }
+    else if (name == "edge")
+    {
+        format = VariantFormat::EdgeMap;
+    }
+    else if (name == "targz")
+    {
+        format = VariantFormat::TarGzip;
+    }
+    else if (name == "segments")
+    {
+        format = VariantFormat::Segments;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+int DefaultVariantLevel(VariantFormat format)
+{
+    switch (format)
+    {
+    case VariantFormat::Png:
+        return 6;
+    case VariantFormat::Webp:
+        return 80;
+    case VariantFormat::TarGzip:
+        return -1;
+    case VariantFormat::Segments:
+        return 10;
+    default:
+        return 0;
+    }
+}
+
+const char* VariantContentType(VariantFormat format)
+{
+    switch (format)
+    {
+    case VariantFormat::Png:
+        return "image/png";
+    case VariantFormat::Webp:
+        return "image/webp";
+    case VariantFormat::TarGzip:
+        return "application/gzip";
+    case VariantFormat::Segments:
+        return SEGMENTSCONTENTTYPE;
+    default:
+        return EDGEMAPCONTENTTYPE;
+    }
+}
+
+std::vector<char> EncodeEdgeMap(const cv::Mat& edges)
+{
+    cv::Mat continuous = edges.isContinuous() ? edges : edges.clone();
+    return EncodeEdgeMap(continuous.ptr<std::uint8_t>(), static_cast<std::uint32_t>(continuous.rows),
+                         static_cast<std::uint32_t>(continuous.cols));
+}
+
+std::vector<char> EncodeEdgeSegments(const cv::Mat& edges, double epsilon)
+{
+    nlohmann::json segments = nlohmann::json::array();
+    for (const EdgeSegment& segment : extractEdgeSegments(edges, epsilon))
+    {
+        std::vector<int> polyline;
+        polyline.reserve(segment.polyline.size() * 2);
+        for (const cv::Point& point : segment.polyline)
+        {
+            polyline.push_back(point.x);
+            polyline.push_back(point.y);
+        }
+        segments.push_back({{"pixels", segment.pixels},
+                            {"length", segment.length},
+                            {"bbox", {segment.bounds.x, segment.bounds.y, segment.bounds.width, segment.bounds.height}},
+                            {"polyline", std::move(polyline)}});
+    }
+    const std::string document =
+        nlohmann::json {{"width", edges.cols}, {"height", edges.rows}, {"segments", std::move(segments)}}.dump();
+    return std::vector<char>(document.begin(), document.end());
+}
+
+VariantCache::VariantCache(std::size_t budget) : m_cache(budget), m_sourceVersion(0)
+{
+}
+
+void VariantCache::setSource(std::uint64_t version, const cv::Mat& edges)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_sourceVersion = version;
+    m_source = edges;
+}
+
+std::shared_ptr<const ImageBlob> VariantCache::get(const VariantKey& key)
+{
+    const std::string id = key.str();
+    if (std::optional<Variant> cached = m_cache.get(id))
+    {
+        return *cached;
+    }
+
+    std::promise<Variant> promise;
+    std::shared_future<Variant> pendingVariant;
+    cv::Mat source;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (key.version != m_sourceVersion || m_source.empty())
+        {
+            return nullptr;
+        }
+        auto pending = m_pending.find(id);
+        if (pending != m_pending.end())
+        {
+            pendingVariant = pending->second;
+        }
+        else
+        {
+            m_pending.emplace(id, promise.get_future().share());
+            source = m_source;
+        }
+    }
+    if (pendingVariant.valid())
+    {
+        return pendingVariant.get();
+    }
+
+    try
+    {
+        Variant variant = encode(source, key);
+        m_cache.put(id, variant, variant->size());
+        promise.set_value(variant);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending.erase(id);
+        return variant;
+    }
+    catch (...)
+    {
+        promise.set_exception(std::current_exception());
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending.erase(id);
+        throw;
+    }
+}
+
+VariantCache::Variant VariantCache::encode(const cv::Mat& source, const VariantKey& key)
+{
+    cv::Mat image = source;
+    if (key.width > 0 && key.width < source.cols)
+    {
+        int height = std::max(1, static_cast<int>(static_cast<long long>(source.rows) * key.width / source.cols));
+        cv::resize(source, image, cv::Size(key.width, height), 0, 0, cv::INTER_AREA);
+    }
+
+    std::vector<char> data;
+    if (key.format == VariantFormat::EdgeMap)
+    {
+        data = EncodeEdgeMap(image);
+    }
+    else if (key.format == VariantFormat::Segments)
+    {
+        if (key.level < 0)
+        {
+            throw std::runtime_error("Negative segment tolerance " + key.str());
+        }
+        data = EncodeEdgeSegments(image, key.level / 10.0);
+    }
+    else
+    {
+        std::vector<uchar> encoded;
+        const char* extension = key.format == VariantFormat::Webp ? ".webp" : ".png";
+        std::vector<int> parameters;
+        if (key.format == VariantFormat::Png)
+        {
+            parameters = {cv::IMWRITE_PNG_COMPRESSION, key.level};
+        }
+        else if (key.format == VariantFormat::Webp)
+        {
+            parameters = {cv::IMWRITE_WEBP_QUALITY, key.level};
+        }
+        if (!cv::imencode(extension, image, encoded, parameters))
+        {
+            throw std::runtime_error("Error encoding variant " + key.str());
+        }
+        if (key.format == VariantFormat::TarGzip)
+        {
+            std::vector<char> archive =
+                BuildTarArchive(VARIANTTARNAME, reinterpret_cast<const char*>(encoded.data()), encoded.size());
+            data = GzipCompress(archive.data(), archive.size(), key.level);
+        }
+        else
+        {
+            data.assign(encoded.begin(), encoded.end());
+        }
+    }
+    // Only the archives and the edge maps have a frame encoding, the other variants are served over HTTP as is
+    FrameCompression encoding = FrameCompression::None;
+    if (key.format == VariantFormat::TarGzip)
+    {
+        encoding = FrameCompression::TarGzip;
+    }
+    else if (key.format == VariantFormat::EdgeMap)
+    {
+        encoding = FrameCompression::EdgeMap;
+    }
+    return std::make_shared<const ImageBlob>(std::move(data), key.version, encoding, false);
+}
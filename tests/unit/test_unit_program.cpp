@@ -6,16 +6,53 @@
 #include "AlertInvasion.h"
 #include "EmergencyNotification.h"
 #include "SuppliesData.h"
+#include "boundedQueue.hpp"
 #include "cannyEdgeFilter.hpp"
+#include "changeDetector.hpp"
+#include "contentHash.hpp"
 #include "cppSocket.hpp"
+#include "edgeDensity.hpp"
+#include "edgeMapCodec.hpp"
+#include "edgeSegments.hpp"
+#include "geoTiffWriter.hpp"
+#include "imageBlob.hpp"
+#include "imageCompression.hpp"
+#include "imageFileOperations.hpp"
+#include "imageHttp.hpp"
+#include "imageProtocol.hpp"
+#include "imageReactor.hpp"
+#include "ingestPipeline.hpp"
+#include "jobManager.hpp"
+#include "planeAllocator.hpp"
+#include "preparedImage.hpp"
+#include "resultCache.hpp"
 #include "rocksDbWrapper.hpp"
+#include "scratchArena.hpp"
+#include "variantCache.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <gdal_priv.h>
 #include <gtest/gtest.h>
 #include <httplib.h>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
 #include <optional>
 #include <regex>
 #include <set>
 #include <signal.h>
+#include <sys/socket.h>
 #include <thread>
+#include <unistd.h>
+#include <zlib.h>
 
 void setRand(int value)
 {
@@ -116,6 +153,17 @@ TEST(UserManagerTest, GetSocketFromToken)
     ASSERT_FALSE(invalidSocket.has_value());
 }
 
+TEST(UserManagerTest, ReleaseSocket)
+{
+    UserManagement::UserManager userManager;
+    userManager.AddUser("testuser", "token123", true, 42);
+    userManager.AddUser("otheruser", "token456", true, 84);
+    userManager.ReleaseSocket(42);
+
+    ASSERT_EQ(userManager.GetSocketFromToken("token123").value(), 0);
+    ASSERT_EQ(userManager.GetSocketFromToken("token456").value(), 84);
+}
+
 TEST(TempAlertTest, GeneratesValidAlertMessage)
 {
     setRand(0);
@@ -172,6 +220,1047 @@ TEST(TempAlertTest, GeneratesNormalAlert)
     }
 }
 
+TEST(EdgeDetectionTest, RoiMatchesFullFrame)
+{
+    cv::Mat image(64, 64, CV_8UC1, cv::Scalar(0));
+    image(cv::Rect(20, 12, 24, 30)).setTo(200);
+    // A faint band whose edge is weak and leaves the third window and its halo
+    image(cv::Rect(0, 46, 64, 18)).setTo(20);
+
+    EdgeDetection edgeDetection(40.0, 80.0, 1.0);
+    edgeDetection.setSaveStages(false);
+    cv::Mat fullEdges = edgeDetection.detectEdges(image).clone();
+
+    // The last window only sees the top left corner, not the gradient directions of the rest of the frame
+    std::vector<cv::Rect> rois = {cv::Rect(10, 5, 20, 20), cv::Rect(50, 50, 30, 30), cv::Rect(0, 40, 30, 12),
+                                  cv::Rect(16, 8, 10, 10)};
+    auto results = edgeDetection.detectEdges(image, rois);
+
+    ASSERT_EQ(results.size(), rois.size());
+    ASSERT_EQ(results[1].roi, cv::Rect(50, 50, 14, 14));
+    for (const auto &result : results)
+    {
+        cv::Mat expected = fullEdges(result.roi);
+        ASSERT_EQ(cv::countNonZero(result.edges != expected), 0);
+        ASSERT_EQ(result.edgePixels, static_cast<std::size_t>(cv::countNonZero(expected)));
+    }
+}
+
+TEST(EdgeDetectionTest, AutoThresholdsFollowTheContrast)
+{
+    cv::Mat bright(64, 64, CV_8UC1, cv::Scalar(0));
+    bright(cv::Rect(16, 16, 32, 32)).setTo(200);
+    cv::Mat dim(64, 64, CV_8UC1, cv::Scalar(0));
+    dim(cv::Rect(16, 16, 32, 32)).setTo(20);
+
+    EdgeDetection edgeDetection(40.0, 80.0, 1.0);
+    edgeDetection.setSaveStages(false);
+    EdgeDetection fixed(40.0, 80.0, 1.0);
+    fixed.setSaveStages(false);
+    for (ThresholdMode mode : {ThresholdMode::Otsu, ThresholdMode::Percentile})
+    {
+        edgeDetection.setThresholdMode(mode);
+        cv::Mat brightEdges = edgeDetection.detectEdges(bright).clone();
+        Thresholds brightThresholds = edgeDetection.thresholds();
+        cv::Mat dimEdges = edgeDetection.detectEdges(dim).clone();
+        Thresholds dimThresholds = edgeDetection.thresholds();
+
+        ASSERT_GE(dimThresholds.low, 1.0F);
+        ASSERT_LE(dimThresholds.low, dimThresholds.high);
+        ASSERT_LT(dimThresholds.high, brightThresholds.high);
+        ASSERT_GT(cv::countNonZero(dimEdges), 0);
+
+        fixed.setThresholds(dimThresholds.low, dimThresholds.high);
+        ASSERT_EQ(cv::countNonZero(fixed.detectEdges(dim) != dimEdges), 0);
+    }
+}
+
+void WriteEnviRaster(const std::filesystem::path& raster, const std::string& interleave, const std::string& dataType,
+                     const std::vector<cv::Mat>& bands)
+{
+    const int count = static_cast<int>(bands.size());
+    const int rows = bands.front().rows;
+    const int cols = bands.front().cols;
+    std::vector<char> data(16 + static_cast<std::size_t>(count) * rows * cols, 'x');
+    for (int band = 0; band < count; ++band)
+    {
+        for (int row = 0; row < rows; ++row)
+        {
+            for (int col = 0; col < cols; ++col)
+            {
+                std::size_t index = interleave == "bsq"   ? (static_cast<std::size_t>(band) * rows + row) * cols + col
+                                    : interleave == "bil" ? (static_cast<std::size_t>(row) * count + band) * cols + col
+                                                          : (static_cast<std::size_t>(row) * cols + col) * count + band;
+                data[16 + index] = static_cast<char>(bands[band].at<uchar>(row, col));
+            }
+        }
+    }
+    std::ofstream(raster, std::ios::binary).write(data.data(), static_cast<std::streamsize>(data.size()));
+
+    std::ofstream header(std::filesystem::path(raster).replace_extension(".hdr"));
+    header << "ENVI\nSamples = " << cols << "\n  LINES=" << rows << "\nbands = " << count
+           << "\nheader offset = 16\ndata type = " << dataType << "\nInterleave = " << interleave
+           << "\nbyte order = 0\n";
+}
+
+TEST(ImageFileOperationsTest, MapsTheFirstBandOfEnviRasters)
+{
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "enviMappingTest";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    std::vector<cv::Mat> bands;
+    for (int band = 0; band < 3; ++band)
+    {
+        cv::Mat plane(5, 7, CV_8UC1);
+        cv::randu(plane, cv::Scalar(0), cv::Scalar(256));
+        bands.push_back(plane);
+    }
+
+    ImageFileOperations imageFileOperations;
+    for (const std::string interleave : {"bsq", "bil", "bip"})
+    {
+        const std::filesystem::path raster = directory / (interleave + ".bin");
+        WriteEnviRaster(raster, interleave, "1", bands);
+        std::shared_ptr<MappedImage> mapped = imageFileOperations.mapImage(raster.string());
+        ASSERT_EQ(mapped->view().type(), CV_8UC1) << interleave;
+        ASSERT_EQ(mapped->view().size(), bands.front().size()) << interleave;
+        ASSERT_EQ(cv::countNonZero(mapped->view() != bands.front()), 0) << interleave;
+    }
+
+    // Depths the engine cannot take and incomplete headers are rejected, so the caller decodes the file instead
+    const std::filesystem::path wide = directory / "wide.bin";
+    WriteEnviRaster(wide, "bsq", "12", bands);
+    ASSERT_THROW(imageFileOperations.mapImage(wide.string()), std::runtime_error);
+    const std::filesystem::path incomplete = directory / "incomplete.bin";
+    WriteEnviRaster(incomplete, "bsq", "1", bands);
+    std::ofstream(directory / "incomplete.hdr") << "ENVI\nsamples = 7\nbands = 3\ndata type = 1\n";
+    ASSERT_THROW(imageFileOperations.mapImage(incomplete.string()), std::runtime_error);
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST(ImageFileOperationsTest, CachesDecodedImagesUntilTheFileChanges)
+{
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "decodedCacheTest";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    const std::string first = (directory / "first.png").string();
+    const std::string second = (directory / "second.png").string();
+    cv::Mat image(40, 60, CV_8UC1, cv::Scalar(0));
+    image(cv::Rect(10, 10, 30, 20)).setTo(200);
+    ASSERT_TRUE(cv::imwrite(first, image));
+    ASSERT_TRUE(cv::imwrite(second, image));
+
+    ImageFileOperations imageFileOperations;
+    cv::Mat loaded = imageFileOperations.loadImage(first);
+    ASSERT_EQ(imageFileOperations.loadImage(first).data, loaded.data);
+    ASSERT_NE(imageFileOperations.decodeImage(first).data, loaded.data);
+
+    // A new size and modification time make a new key, the stale entry is never served again
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    cv::Mat larger(50, 60, CV_8UC1, cv::Scalar(90));
+    ASSERT_TRUE(cv::imwrite(first, larger));
+    cv::Mat reloaded = imageFileOperations.loadImage(first);
+    ASSERT_NE(reloaded.data, loaded.data);
+    ASSERT_EQ(reloaded.size(), larger.size());
+
+    // Room for a single image: loading the second one evicts the first
+    ImageFileOperations::setCacheBudget(larger.total());
+    cv::Mat other = imageFileOperations.loadImage(second);
+    ASSERT_EQ(imageFileOperations.loadImage(second).data, other.data);
+    ASSERT_NE(imageFileOperations.loadImage(first).data, reloaded.data);
+    ImageFileOperations::setCacheBudget(DECODED_CACHE_BUDGET);
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST(EdgeDetectionTest, ThresholdChangesOnAnUnchangedFileMatchAFreshRun)
+{
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "thresholdRerunTest";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    const std::string input = (directory / "input.png").string();
+    cv::Mat image(64, 64, CV_8UC1, cv::Scalar(0));
+    image(cv::Rect(10, 10, 30, 40)).setTo(20);
+    cv::circle(image, cv::Point(40, 36), 14, cv::Scalar(220), cv::FILLED);
+    ASSERT_TRUE(cv::imwrite(input, image));
+
+    EdgeDetection rerun(40.0, 80.0, 1.0);
+    rerun.setSaveStages(false);
+    rerun.cannyEdgeDetection(input, (directory / "first.png").string());
+    rerun.setThresholds(100.0F, 200.0F);
+    rerun.cannyEdgeDetection(input, (directory / "rerun.png").string());
+
+    EdgeDetection fresh(100.0, 200.0, 1.0);
+    fresh.setSaveStages(false);
+    fresh.cannyEdgeDetection(input, (directory / "fresh.png").string());
+
+    cv::Mat first = cv::imread((directory / "first.png").string(), cv::IMREAD_GRAYSCALE);
+    cv::Mat rerunEdges = cv::imread((directory / "rerun.png").string(), cv::IMREAD_GRAYSCALE);
+    cv::Mat freshEdges = cv::imread((directory / "fresh.png").string(), cv::IMREAD_GRAYSCALE);
+    ASSERT_EQ(rerunEdges.size(), image.size());
+    ASSERT_EQ(cv::countNonZero(rerunEdges != freshEdges), 0);
+    ASSERT_GT(cv::countNonZero(first != rerunEdges), 0);
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST(EdgeDetectionTest, SavesTiledCompressedGeoTiffWithTheInputGeoreference)
+{
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "geoTiffOutputTest";
+    std::filesystem::remove_all(directory);
+    std::filesystem::create_directories(directory);
+    const std::string input = (directory / "input.tif").string();
+    const std::string output = (directory / "edges.tif").string();
+    cv::Mat image(40, 48, CV_8UC1, cv::Scalar(0));
+    image(cv::Rect(8, 6, 24, 20)).setTo(200);
+    const std::array<double, 6> geoTransform = {500000.0, 10.0, 0.0, 4200000.0, 0.0, -10.0};
+    {
+        GeoTiffWriter source(input, image.cols, image.rows, CV_8UC1,
+                             {GeoTiffCompression::None, GeoTiffPredictor::None, -1, 16, 1});
+        source.setGeoTransform(geoTransform);
+        source.write(image);
+    }
+
+    EdgeDetection edgeDetection(40.0, 80.0, 1.0);
+    edgeDetection.setSaveStages(false);
+    GeoTiffOptions options;
+    options.tileSize = 16;
+    edgeDetection.setGeoTiffOptions(options);
+    edgeDetection.cannyEdgeDetection(input, output);
+    EdgeDetection reference(40.0, 80.0, 1.0);
+    reference.setSaveStages(false);
+    cv::Mat expected = reference.detectEdges(image).clone();
+    ASSERT_GT(cv::countNonZero(expected), 0);
+
+    GDALAllRegister();
+    auto* dataset = static_cast<GDALDataset*>(GDALOpen(output.c_str(), GA_ReadOnly));
+    ASSERT_NE(dataset, nullptr);
+    GDALRasterBand* band = dataset->GetRasterBand(1);
+    cv::Mat written(dataset->GetRasterYSize(), dataset->GetRasterXSize(), CV_8UC1);
+    ASSERT_EQ(band->RasterIO(GF_Read, 0, 0, written.cols, written.rows, written.data, written.cols, written.rows,
+                             GDT_Byte, 0, 0),
+              CE_None);
+    int blockX = 0;
+    int blockY = 0;
+    band->GetBlockSize(&blockX, &blockY);
+    const char* compressionItem = dataset->GetMetadataItem("COMPRESSION", "IMAGE_STRUCTURE");
+    const std::string compression = compressionItem != nullptr ? compressionItem : "";
+    std::array<double, 6> writtenTransform {};
+    const bool georeferenced = dataset->GetGeoTransform(writtenTransform.data()) == CE_None;
+    GDALClose(dataset);
+
+    ASSERT_EQ(written.size(), image.size());
+    ASSERT_EQ(cv::countNonZero(written != expected), 0);
+    ASSERT_EQ(blockX, 16);
+    ASSERT_EQ(blockY, 16);
+    ASSERT_EQ(compression, "DEFLATE");
+    ASSERT_TRUE(georeferenced);
+    ASSERT_EQ(writtenTransform, geoTransform);
+
+    std::filesystem::remove_all(directory);
+}
+
+TEST(ChangeDetectorTest, RecomputesOnlyChangedTiles)
+{
+    cv::Mat frame(128, 128, CV_8UC1, cv::Scalar(0));
+    frame(cv::Rect(10, 10, 30, 30)).setTo(200);
+
+    EdgeDetection edgeDetection(40.0, 80.0, 1.0);
+    edgeDetection.setSaveStages(false);
+    ChangeDetector changeDetector(64, 8.0);
+    ASSERT_TRUE(changeDetector.process(edgeDetection, frame).fullRecompute);
+
+    frame(cv::Rect(80, 80, 30, 30)).setTo(200);
+    const auto &result = changeDetector.process(edgeDetection, frame);
+
+    ASSERT_FALSE(result.fullRecompute);
+    ASSERT_EQ(result.changed.size(), 1u);
+    ASSERT_EQ(result.changed[0], cv::Rect(64, 64, 64, 64));
+    ASSERT_EQ(result.tileMask.at<uchar>(1, 1), 255);
+    ASSERT_EQ(cv::countNonZero(result.tileMask), 1);
+
+    cv::Mat expected = edgeDetection.detectEdges(frame);
+    ASSERT_EQ(cv::countNonZero(result.edges != expected), 0);
+}
+
+TEST(ChangeDetectorTest, WeakChainsAcrossTilesMatchFullDetection)
+{
+    // A horizontal edge, strong in the left tile and weak from x = 40 on, so its weak part crosses into the right tile
+    cv::Mat frame(64, 128, CV_8UC1, cv::Scalar(0));
+    frame(cv::Rect(0, 32, 40, 32)).setTo(200);
+    frame(cv::Rect(40, 32, 88, 32)).setTo(30);
+    const cv::Rect rightTile(64, 0, 64, 64);
+
+    EdgeDetection edgeDetection(20.0, 200.0, 1.0);
+    edgeDetection.setSaveStages(false);
+    ChangeDetector changeDetector(64, 8.0);
+    ASSERT_GT(cv::countNonZero(changeDetector.process(edgeDetection, frame).edges(rightTile)), 0);
+
+    // Take the strong part of the chain away, only the left tile is recomputed
+    frame(cv::Rect(0, 32, 40, 32)).setTo(30);
+    const auto &result = changeDetector.process(edgeDetection, frame);
+    ASSERT_FALSE(result.fullRecompute);
+    ASSERT_EQ(result.changed.size(), 1u);
+    ASSERT_EQ(result.changed[0], cv::Rect(0, 0, 64, 64));
+
+    cv::Mat expected = edgeDetection.detectEdges(frame);
+    ASSERT_EQ(cv::countNonZero(result.edges != expected), 0);
+}
+
+TEST(ChangeDetectorTest, ChangesAtATileBorderUpdateTheNeighbourTile)
+{
+    // The block lies in the left tile against its border, its right edge falls in the right tile
+    cv::Mat plain(64, 128, CV_8UC1, cv::Scalar(200));
+    cv::Mat block = plain.clone();
+    block(cv::Rect(56, 16, 8, 32)).setTo(0);
+    const cv::Rect rightTile(64, 0, 64, 64);
+
+    EdgeDetection edgeDetection(40.0, 80.0, 1.0);
+    edgeDetection.setSaveStages(false);
+    ChangeDetector changeDetector(64, 8.0);
+    ASSERT_GT(cv::countNonZero(changeDetector.process(edgeDetection, block).edges(rightTile)), 0);
+
+    // The block disappearing must not leave its edge behind, nor its return miss it
+    for (const cv::Mat& frame : {plain, block})
+    {
+        const auto &result = changeDetector.process(edgeDetection, frame);
+        ASSERT_FALSE(result.fullRecompute);
+        ASSERT_EQ(result.changed.size(), 1u);
+        ASSERT_EQ(result.changed[0], cv::Rect(0, 0, 64, 64));
+
+        cv::Mat expected = edgeDetection.detectEdges(frame);
+        ASSERT_EQ(cv::countNonZero(result.edges != expected), 0);
+    }
+}
+
+TEST(PreparedImageTest, ThresholdSweepsMatchFullDetection)
+{
+    cv::Mat image(96, 96, CV_8UC1, cv::Scalar(0));
+    image(cv::Rect(10, 10, 30, 40)).setTo(90);
+    cv::circle(image, cv::Point(64, 60), 18, cv::Scalar(220), cv::FILLED);
+
+    EdgeDetection edgeDetection(40.0, 80.0, 1.0);
+    edgeDetection.setSaveStages(false);
+    PreparedImage prepared = edgeDetection.prepareImage(image);
+
+    std::vector<Thresholds> sweep = {{10.0F, 20.0F}, {40.0F, 80.0F}, {90.0F, 180.0F}};
+    for (const auto &thresholds : sweep)
+    {
+        edgeDetection.setThresholds(thresholds.low, thresholds.high);
+        cv::Mat expected = edgeDetection.detectEdges(image);
+        ASSERT_EQ(cv::countNonZero(prepared.threshold(thresholds) != expected), 0);
+    }
+
+    for (const auto &thresholds : {prepared.otsuThresholds(), prepared.medianThresholds()})
+    {
+        ASSERT_GE(thresholds.low, 1.0F);
+        ASSERT_LE(thresholds.low, thresholds.high);
+        ASSERT_LE(thresholds.high, 255.0F);
+        ASSERT_GT(cv::countNonZero(prepared.threshold(thresholds)), 0);
+    }
+
+    // Both paths choose from the same histogram, so the automatic thresholds agree
+    edgeDetection.setThresholdMode(ThresholdMode::Otsu);
+    cv::Mat otsuEdges = edgeDetection.detectEdges(image);
+    Thresholds otsu = prepared.otsuThresholds();
+    ASSERT_EQ(edgeDetection.thresholds().low, otsu.low);
+    ASSERT_EQ(edgeDetection.thresholds().high, otsu.high);
+    ASSERT_EQ(cv::countNonZero(prepared.threshold(otsu) != otsuEdges), 0);
+}
+
+TEST(EdgeSegmentsTest, StitchesSegmentsAcrossTiles)
+{
+    cv::Mat edges(100, 100, CV_8UC1, cv::Scalar(0));
+    edges.at<uchar>(2, 2) = 255;
+    cv::rectangle(edges, cv::Rect(20, 20, 20, 20), cv::Scalar(255));
+    cv::line(edges, cv::Point(5, 50), cv::Point(95, 50), cv::Scalar(255));
+    cv::line(edges, cv::Point(58, 58), cv::Point(70, 70), cv::Scalar(255));
+
+    std::vector<EdgeSegment> segments = extractEdgeSegments(edges, 1.0, 32);
+    ASSERT_EQ(segments.size(), 4U);
+    ASSERT_EQ(segments[0].pixels, 1U);
+    ASSERT_EQ(segments[1].bounds, cv::Rect(20, 20, 20, 20));
+    ASSERT_EQ(segments[1].pixels, 76U);
+    ASSERT_EQ(segments[2].bounds, cv::Rect(5, 50, 91, 1));
+    ASSERT_DOUBLE_EQ(segments[2].length, 90.0);
+    ASSERT_EQ(segments[2].polyline.size(), 2U);
+    ASSERT_EQ(segments[3].bounds, cv::Rect(58, 58, 13, 13));
+
+    std::vector<EdgeSegment> whole = extractEdgeSegments(edges, 1.0, 1024);
+    ASSERT_EQ(whole.size(), segments.size());
+    for (std::size_t index = 0; index < whole.size(); ++index)
+    {
+        ASSERT_EQ(whole[index].bounds, segments[index].bounds);
+        ASSERT_EQ(whole[index].pixels, segments[index].pixels);
+        ASSERT_EQ(whole[index].polyline, segments[index].polyline);
+    }
+
+    std::vector<char> encoded = EncodeEdgeSegments(edges, 1.0);
+    nlohmann::json document = nlohmann::json::parse(encoded.begin(), encoded.end());
+    ASSERT_EQ(document["segments"].size(), 4U);
+    ASSERT_EQ(document["segments"][2]["bbox"], nlohmann::json({5, 50, 91, 1}));
+}
+
+TEST(PlaneAllocatorTest, ReusesReleasedPlanes)
+{
+    PlaneAllocator allocator(PLANE_POOL_BUDGET, std::size_t {1} << 20);
+    {
+        cv::Mat small = allocator.plane(cv::Size(16, 16), CV_8UC1);
+        ASSERT_EQ(allocator.stats().mapped, 0U);
+    }
+
+    const uchar* first = nullptr;
+    {
+        cv::Mat plane = allocator.plane(cv::Size(1024, 1024), CV_32F);
+        ASSERT_TRUE(plane.isContinuous());
+        ASSERT_EQ(reinterpret_cast<std::uintptr_t>(plane.data) % PLANE_HUGE_PAGE, 0U);
+        plane.setTo(1.0F);
+        first = plane.data;
+    }
+    ASSERT_EQ(allocator.stats().pooledBytes, std::size_t {4} << 20);
+
+    cv::Mat again = allocator.plane(cv::Size(1024, 1024), CV_32F);
+    ASSERT_EQ(static_cast<const void*>(again.data), static_cast<const void*>(first));
+    ASSERT_EQ(allocator.stats().mapped, 1U);
+    ASSERT_EQ(allocator.stats().reused, 1U);
+    ASSERT_EQ(allocator.stats().pooledBytes, 0U);
+
+    cv::Mat frame(1024, 1024, CV_8UC1, cv::Scalar(0));
+    frame(cv::Rect(100, 100, 300, 300)).setTo(200);
+    EdgeDetection edgeDetection(40.0, 80.0, 1.0);
+    edgeDetection.setSaveStages(false);
+    cv::Mat edges = edgeDetection.detectEdges(frame).clone();
+    const std::size_t mapped = PlaneAllocator::instance()->stats().mapped;
+    ASSERT_EQ(cv::countNonZero(edgeDetection.detectEdges(frame) != edges), 0);
+    ASSERT_EQ(PlaneAllocator::instance()->stats().mapped, mapped);
+}
+
+TEST(ScratchArenaTest, HandsOutViewsOfTheLargestFrame)
+{
+    ScratchArena arena;
+    cv::Mat large = arena.view(ScratchPlane::Blur, cv::Size(100, 50), CV_8UC1);
+    cv::Mat small = arena.view(ScratchPlane::Blur, cv::Size(80, 40), CV_8UC1);
+    ASSERT_EQ(static_cast<const void*>(small.data), static_cast<const void*>(large.data));
+    ASSERT_EQ(arena.bytes(), 100U * 50U);
+
+    arena.view(ScratchPlane::Blur, cv::Size(120, 30), CV_8UC1);
+    ASSERT_EQ(arena.bytes(), 120U * 50U);
+
+    cv::Mat big(96, 128, CV_8UC1, cv::Scalar(0));
+    big(cv::Rect(20, 20, 50, 40)).setTo(200);
+    cv::Mat frame(64, 72, CV_8UC1, cv::Scalar(0));
+    frame(cv::Rect(10, 12, 30, 25)).setTo(200);
+
+    EdgeDetection reused(40.0, 80.0, 1.0);
+    reused.setSaveStages(false);
+    reused.detectEdges(big);
+    EdgeDetection fresh(40.0, 80.0, 1.0);
+    fresh.setSaveStages(false);
+    ASSERT_EQ(cv::countNonZero(reused.detectEdges(frame) != fresh.detectEdges(frame)), 0);
+}
+
+TEST(ImageCompressionTest, GzipRoundTrip)
+{
+    std::vector<char> data(3 * GZIPBLOCK + 123);
+    for (std::size_t i = 0; i < data.size(); ++i)
+    {
+        data[i] = static_cast<char>((i * 7) % 251);
+    }
+    std::vector<char> archive = BuildTarArchive("canny.png", data.data(), data.size());
+    ASSERT_EQ(archive.size() % TARBLOCK, 0u);
+
+    std::vector<char> compressed = GzipCompress(archive.data(), archive.size(), Z_DEFAULT_COMPRESSION);
+
+    z_stream stream {};
+    ASSERT_EQ(inflateInit2(&stream, 16 + MAX_WBITS), Z_OK);
+    std::vector<char> restored(archive.size());
+    stream.next_in = reinterpret_cast<Bytef*>(compressed.data());
+    stream.avail_in = static_cast<uInt>(compressed.size());
+    stream.next_out = reinterpret_cast<Bytef*>(restored.data());
+    stream.avail_out = static_cast<uInt>(restored.size());
+    int result = inflate(&stream, Z_FINISH);
+    inflateEnd(&stream);
+
+    ASSERT_EQ(result, Z_STREAM_END);
+    ASSERT_EQ(restored, archive);
+    ASSERT_EQ(std::memcmp(archive.data() + TARBLOCK, data.data(), data.size()), 0);
+}
+
+TEST(EdgeDensityTest, CountsCellsAndEntryZones)
+{
+    std::vector<std::uint8_t> pixels(64 * 100, 0);
+    std::fill_n(pixels.begin(), 8 * 100, 255);
+    pixels[40 * 100 + 70] = 255;
+
+    EdgeDensity density = ComputeEdgeDensity(pixels.data(), 64, 100, 4);
+    ASSERT_EQ(density.cells.size(), 16U);
+    for (int cell = 0; cell < 4; ++cell)
+    {
+        ASSERT_DOUBLE_EQ(density.cells[cell], 0.5);
+    }
+    ASSERT_DOUBLE_EQ(density.cells[2 * 4 + 2], 1.0 / (16 * 25));
+    ASSERT_DOUBLE_EQ(density.cells[3 * 4 + 3], 0.0);
+    ASSERT_DOUBLE_EQ(density.total, 801.0 / (64 * 100));
+    ASSERT_DOUBLE_EQ(density.zones["north_entry"], 0.5);
+    ASSERT_DOUBLE_EQ(density.zones["south_entry"], 0.0);
+    ASSERT_DOUBLE_EQ(density.zones["east_entry"], 200.0 / (64 * 25));
+    ASSERT_DOUBLE_EQ(density.zones["west_entry"], 200.0 / (64 * 25));
+
+    nlohmann::json summary = nlohmann::json::parse(density.toJson());
+    ASSERT_EQ(summary["grid"], 4);
+    ASSERT_DOUBLE_EQ(summary["zones"]["north_entry"].get<double>(), 0.5);
+}
+
+TEST(ImageBlobTest, KeepsContentAndMetadata)
+{
+    std::vector<char> data(10000);
+    for (std::size_t i = 0; i < data.size(); ++i)
+    {
+        data[i] = static_cast<char>(i % 251);
+    }
+    std::vector<char> copy = data;
+
+    ImageBlob blob(std::move(data), 7, FrameCompression::None);
+
+    ASSERT_EQ(blob.version(), 7u);
+    ASSERT_EQ(blob.encoding(), FrameCompression::None);
+    ASSERT_EQ(blob.size(), copy.size());
+    ASSERT_EQ(std::memcmp(blob.data(), copy.data(), copy.size()), 0);
+    ASSERT_EQ(blob.hash(), ContentHash(copy.data(), copy.size()));
+    ASSERT_EQ(blob.hash(), ContentHash(copy.data() + 4000, 6000, ContentHash(copy.data(), 4000)));
+    ASSERT_NE(blob.hash(), ContentHash(copy.data(), copy.size() - 1));
+}
+
+TEST(ImageProtocolTest, RejectsUnknownTypesAndEncodings)
+{
+    FrameHeader header;
+    header.compression = FrameCompression::TarGzip;
+    header.totalSize = 10;
+    header.length = 10;
+    FrameBytes bytes = EncodeFrameHeader(header);
+    FrameHeader decoded;
+    ASSERT_TRUE(DecodeFrameHeader(bytes, decoded));
+    ASSERT_EQ(decoded.compression, FrameCompression::TarGzip);
+
+    FrameBytes unknownEncoding = bytes;
+    unknownEncoding[6] = 9;
+    ASSERT_FALSE(DecodeFrameHeader(unknownEncoding, decoded));
+    FrameBytes unknownType = bytes;
+    unknownType[5] = 7;
+    ASSERT_FALSE(DecodeFrameHeader(unknownType, decoded));
+}
+
+TEST(EdgeMapCodecTest, RoundTripsEveryMode)
+{
+    // Odd sizes so the last packed word and byte are partial
+    const std::uint32_t rows = 37;
+    const std::uint32_t cols = 53;
+    std::vector<std::uint8_t> pixels(rows * cols, 0);
+    for (std::size_t i = 0; i < pixels.size(); i += 7 + i % 13)
+    {
+        pixels[i] = static_cast<std::uint8_t>(1 + i % 255);
+    }
+
+    for (EdgeMapMode mode : {EdgeMapMode::Packed, EdgeMapMode::Runs, EdgeMapMode::Sparse})
+    {
+        std::vector<char> encoded = EncodeEdgeMap(pixels.data(), rows, cols, mode);
+        EdgeMap decoded = DecodeEdgeMap(encoded.data(), encoded.size());
+        ASSERT_EQ(decoded.rows, rows);
+        ASSERT_EQ(decoded.cols, cols);
+        for (std::size_t i = 0; i < pixels.size(); ++i)
+        {
+            ASSERT_EQ(decoded.pixels[i], pixels[i] != 0 ? 255 : 0);
+        }
+    }
+
+    // Sparse edges are smaller as gaps than as a bitmap
+    std::vector<char> best = EncodeEdgeMap(pixels.data(), rows, cols);
+    ASSERT_EQ(static_cast<EdgeMapMode>(best[5]), EdgeMapMode::Sparse);
+    ASSERT_LT(best.size(), EncodeEdgeMap(pixels.data(), rows, cols, EdgeMapMode::Packed).size());
+    ASSERT_THROW(DecodeEdgeMap(best.data(), EDGEMAPHEADERSIZE - 1), std::runtime_error);
+}
+
+TEST(VariantCacheTest, EncodesOncePerKeyAndVersion)
+{
+    cv::Mat edges = cv::Mat::zeros(4, 8, CV_8UC1);
+    edges.at<uchar>(1, 2) = 255;
+    edges.at<uchar>(1, 3) = 255;
+
+    VariantCache cache;
+    cache.setSource(3, edges);
+    VariantKey key {3, 0, VariantFormat::EdgeMap, 0};
+    std::shared_ptr<const ImageBlob> variant = cache.get(key);
+
+    ASSERT_NE(variant, nullptr);
+    EdgeMap decoded = DecodeEdgeMap(variant->data(), variant->size());
+    ASSERT_EQ(decoded.rows, 4u);
+    ASSERT_EQ(decoded.cols, 8u);
+    ASSERT_EQ(std::memcmp(decoded.pixels.data(), edges.data, decoded.pixels.size()), 0);
+    ASSERT_EQ(variant->fd(), -1);
+    ASSERT_EQ(cache.get(key), variant);
+
+    cache.setSource(4, edges);
+    ASSERT_EQ(cache.get(key), nullptr);
+}
+
+TEST(BoundedQueueTest, BlocksWhenFullAndDrainsAfterClose)
+{
+    BoundedQueue<int> queue(2);
+    ASSERT_TRUE(queue.push(1));
+    ASSERT_TRUE(queue.push(2));
+
+    std::atomic<bool> pushed(false);
+    std::thread producer([&] {
+        queue.push(3);
+        pushed = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    ASSERT_FALSE(pushed);
+
+    ASSERT_EQ(queue.pop(), 1);
+    producer.join();
+    ASSERT_TRUE(pushed);
+
+    queue.close();
+    ASSERT_FALSE(queue.push(4));
+    ASSERT_EQ(queue.pop(), 2);
+    ASSERT_EQ(queue.pop(), 3);
+    ASSERT_EQ(queue.pop(), std::nullopt);
+}
+
+TEST(IngestPipelineTest, PublishesImagesDroppedInTheWatchedDirectory)
+{
+    std::filesystem::path directory = std::filesystem::temp_directory_path() / "ingestPipelineTest";
+    std::filesystem::remove_all(directory);
+
+    std::mutex mutex;
+    std::condition_variable published;
+    std::vector<cv::Size> sizes;
+    IngestPipeline pipeline([&](const cv::Mat& edges, std::vector<char>&& data) {
+        EdgeMap decoded = DecodeEdgeMap(data.data(), data.size());
+        ASSERT_EQ(static_cast<int>(decoded.cols), edges.cols);
+        std::lock_guard<std::mutex> lock(mutex);
+        sizes.push_back(edges.size());
+        published.notify_all();
+    });
+    pipeline.watch(directory.string());
+
+    cv::Mat frame(48, 64, CV_8UC1, cv::Scalar(0));
+    cv::rectangle(frame, cv::Rect(16, 12, 24, 20), cv::Scalar(255), cv::FILLED);
+    ASSERT_TRUE(cv::imwrite((directory / ".frame.png").string(), frame));
+    std::filesystem::rename(directory / ".frame.png", directory / "frame.png");
+
+    std::unique_lock<std::mutex> lock(mutex);
+    ASSERT_TRUE(published.wait_for(lock, std::chrono::seconds(10), [&] { return !sizes.empty(); }));
+    ASSERT_EQ(sizes.front(), frame.size());
+    lock.unlock();
+
+    pipeline.stop();
+    std::filesystem::remove_all(directory);
+}
+
+TEST(ImageHttpTest, MatchesIfNoneMatchLists)
+{
+    const std::string etag = "\"5f3a-12\"";
+    ASSERT_TRUE(MatchesIfNoneMatch(etag, etag));
+    ASSERT_TRUE(MatchesIfNoneMatch("*", etag));
+    ASSERT_TRUE(MatchesIfNoneMatch("W/" + etag, etag));
+    ASSERT_TRUE(MatchesIfNoneMatch("\"other\" ,\tW/" + etag, etag));
+    ASSERT_FALSE(MatchesIfNoneMatch("", etag));
+    ASSERT_FALSE(MatchesIfNoneMatch("\"5f3a-123\", \"other\"", etag));
+    ASSERT_FALSE(MatchesIfNoneMatch("\"x\"5f3a-12\"\"", etag));
+    ASSERT_FALSE(MatchesIfNoneMatch("5f3a-12", etag));
+    ASSERT_FALSE(MatchesIfNoneMatch("\"5f3a-12", etag));
+}
+
+TEST(ImageHttpTest, AnswersNotModifiedUntilTheImageIsRepublished)
+{
+    VariantCache variantCache;
+    std::mutex mutex;
+    std::shared_ptr<const ImageBlob> published =
+        std::make_shared<ImageBlob>(std::vector<char> {'a', 'b', 'c'}, 1, FrameCompression::EdgeMap, false);
+    httplib::Server server;
+    server.Get("/image", [&](const httplib::Request &req, httplib::Response &res) {
+        std::shared_ptr<const ImageBlob> image;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            image = published;
+        }
+        ServeImage(req, res, image, variantCache);
+    });
+    int port = server.bind_to_any_port("127.0.0.1");
+    ASSERT_GT(port, 0);
+    std::thread listener([&] { server.listen_after_bind(); });
+
+    httplib::Client client("127.0.0.1", port);
+    auto first = client.Get("/image");
+    ASSERT_TRUE(first);
+    ASSERT_EQ(first->status, 200);
+    ASSERT_EQ(first->body, "abc");
+    std::string etag = first->get_header_value("ETag");
+    ASSERT_FALSE(etag.empty());
+
+    auto cached = client.Get("/image", {{"If-None-Match", etag}});
+    ASSERT_TRUE(cached);
+    ASSERT_EQ(cached->status, 304);
+    ASSERT_TRUE(cached->body.empty());
+    auto weak = client.Get("/image", {{"If-None-Match", "\"stale\", W/" + etag}});
+    ASSERT_TRUE(weak);
+    ASSERT_EQ(weak->status, 304);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        published = std::make_shared<ImageBlob>(std::vector<char> {'a', 'b', 'd'}, 2, FrameCompression::EdgeMap, false);
+    }
+    auto republished = client.Get("/image", {{"If-None-Match", etag}});
+    ASSERT_TRUE(republished);
+    ASSERT_EQ(republished->status, 200);
+    ASSERT_EQ(republished->body, "abd");
+    ASSERT_NE(republished->get_header_value("ETag"), etag);
+
+    server.stop();
+    listener.join();
+}
+
+JobStatus WaitForJob(const JobManager& jobManager, const std::string& id)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    std::optional<JobStatus> status = jobManager.status(id);
+    while (status.has_value() && (status->state == JobState::Queued || status->state == JobState::Running) &&
+           std::chrono::steady_clock::now() < deadline)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        status = jobManager.status(id);
+    }
+    return status.value_or(JobStatus());
+}
+
+TEST(JobManagerTest, ProcessesUploadsAndReportsFailures)
+{
+    cv::Mat frame(48, 64, CV_8UC1, cv::Scalar(0));
+    cv::rectangle(frame, cv::Rect(16, 12, 24, 20), cv::Scalar(255), cv::FILLED);
+    std::vector<uchar> png;
+    ASSERT_TRUE(cv::imencode(".png", frame, png));
+
+    JobManager jobManager(1, 4);
+    std::optional<std::string> good = jobManager.submit(std::vector<char>(png.begin(), png.end()), 0);
+    std::optional<std::string> bad = jobManager.submit(std::vector<char>(100, 'x'), JOBMAXPRIORITY);
+    ASSERT_TRUE(good.has_value());
+    ASSERT_TRUE(bad.has_value());
+    ASSERT_NE(good.value(), bad.value());
+    ASSERT_FALSE(jobManager.status("unknown").has_value());
+
+    JobStatus done = WaitForJob(jobManager, good.value());
+    ASSERT_EQ(done.state, JobState::Done);
+    ASSERT_EQ(done.progress, PROGRESS_DONE);
+    EdgeMap edges = DecodeEdgeMap(done.result->data(), done.result->size());
+    ASSERT_EQ(static_cast<int>(edges.rows), frame.rows);
+    ASSERT_EQ(static_cast<int>(edges.cols), frame.cols);
+
+    JobStatus failed = WaitForJob(jobManager, bad.value());
+    ASSERT_EQ(failed.state, JobState::Failed);
+    ASSERT_FALSE(failed.error.empty());
+
+    JobManager fullManager(1, 0);
+    ASSERT_FALSE(fullManager.submit(std::vector<char>(png.begin(), png.end()), 0).has_value());
+}
+
+TEST(JobManagerTest, RejectsUploadsAbovePixelLimit)
+{
+    cv::Mat frame(48, 64, CV_8UC1, cv::Scalar(0));
+    std::vector<uchar> png;
+    ASSERT_TRUE(cv::imencode(".png", frame, png));
+    // Claim 65536 x 65536 pixels in the IHDR chunk, the decoder would allocate them
+    std::vector<char> bomb(png.begin(), png.end());
+    bomb[16] = bomb[20] = 0;
+    bomb[17] = bomb[21] = 1;
+    bomb[18] = bomb[22] = 0;
+    bomb[19] = bomb[23] = 0;
+
+    JobManager jobManager(1, 4);
+    std::optional<std::string> id = jobManager.submit(std::move(bomb), 0);
+    ASSERT_TRUE(id.has_value());
+    JobStatus failed = WaitForJob(jobManager, id.value());
+    ASSERT_EQ(failed.state, JobState::Failed);
+    ASSERT_NE(failed.error.find("too large"), std::string::npos);
+}
+
+TEST(JobManagerTest, WakesWaitersOnProgressOfTrackedJobs)
+{
+    JobManager jobManager(1, 4);
+    std::string id = jobManager.track();
+    std::optional<JobStatus> status = jobManager.wait(id, std::chrono::milliseconds(10), 0);
+    ASSERT_TRUE(status.has_value());
+    ASSERT_EQ(status->state, JobState::Queued);
+
+    std::thread worker([&] {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        jobManager.update(id, JobState::Running, PROGRESS_SOBEL);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        JobStatus done;
+        done.state = JobState::Done;
+        done.progress = PROGRESS_DONE;
+        jobManager.finish(id, std::move(done));
+    });
+    status = jobManager.wait(id, std::chrono::seconds(10), 0);
+    ASSERT_EQ(status->state, JobState::Running);
+    ASSERT_EQ(status->progress, PROGRESS_SOBEL);
+    status = jobManager.wait(id, std::chrono::seconds(10));
+    worker.join();
+    ASSERT_EQ(status->state, JobState::Done);
+    ASSERT_FALSE(status->result);
+    ASSERT_FALSE(jobManager.wait("unknown", std::chrono::milliseconds(10)).has_value());
+}
+
+TEST(ResultCacheTest, ServesRepeatedUploadsWithoutRecomputing)
+{
+    cv::Mat frame(48, 64, CV_8UC1, cv::Scalar(0));
+    cv::circle(frame, cv::Point(32, 24), 12, cv::Scalar(255), cv::FILLED);
+    std::vector<uchar> png;
+    ASSERT_TRUE(cv::imencode(".png", frame, png));
+    std::filesystem::path storePath = std::filesystem::temp_directory_path() / "result_cache_test_db";
+    std::filesystem::remove_all(storePath);
+
+    std::string first;
+    {
+        RocksDbWrapper store(storePath.string(), RESULTSTOREBUDGET);
+        ResultCache cache(RESULTBUDGET, &store);
+        JobManager jobManager(1, 4, JOBRETENTION, &cache);
+        CannyParameters strict {60.0F, 120.0F, 1.5F};
+        ASSERT_TRUE(strict.valid());
+        ASSERT_FALSE((CannyParameters {80.0F, 40.0F, 1.0F}.valid()));
+
+        first = jobManager.submit(std::vector<char>(png.begin(), png.end()), 0, strict).value();
+        ASSERT_EQ(WaitForJob(jobManager, first).state, JobState::Done);
+        std::string repeated = jobManager.submit(std::vector<char>(png.begin(), png.end()), 0, strict).value();
+        std::optional<JobStatus> cached = jobManager.status(repeated);
+        ASSERT_EQ(cached->state, JobState::Done);
+        ASSERT_EQ(cached->result, jobManager.status(first)->result);
+        std::string other = jobManager.submit(std::vector<char>(png.begin(), png.end()), 0).value();
+        ASSERT_EQ(WaitForJob(jobManager, other).state, JobState::Done);
+
+        ResultCacheStats stats = cache.stats();
+        ASSERT_EQ(stats.memoryHits, 1U);
+        ASSERT_EQ(stats.storeHits, 0U);
+        ASSERT_GE(stats.misses, 2U);
+        ASSERT_GT(stats.bytes, 0U);
+    }
+
+    RocksDbWrapper store(storePath.string(), RESULTSTOREBUDGET);
+    ResultCache cache(RESULTBUDGET, &store);
+    ResultKey key = ResultKey::of(reinterpret_cast<const char*>(png.data()), png.size(), {60.0F, 120.0F, 1.5F});
+    std::shared_ptr<const ImageBlob> stored = cache.get(key);
+    ASSERT_NE(stored, nullptr);
+    EdgeMap edges = DecodeEdgeMap(stored->data(), stored->size());
+    ASSERT_EQ(static_cast<int>(edges.rows), frame.rows);
+    ASSERT_EQ(cache.stats().storeHits, 1U);
+    ASSERT_EQ(cache.get(key), stored);
+    ASSERT_EQ(cache.stats().memoryHits, 1U);
+    std::filesystem::remove_all(storePath);
+}
+
+bool ReadAll(int socket, char* data, std::size_t size)
+{
+    std::size_t received = 0;
+    while (received < size)
+    {
+        ssize_t bytes = read(socket, data + received, size - received);
+        if (bytes <= 0)
+        {
+            return false;
+        }
+        received += bytes;
+    }
+    return true;
+}
+
+TEST(ImageReactorTest, HandshakeThenDeliversQueuedImages)
+{
+    std::mutex mutex;
+    std::condition_variable tokenReceived;
+    std::shared_ptr<const ImageBlob> image;
+    std::string token;
+    int tokenSocket = -1;
+
+    ImageReactor reactor(
+        [&] {
+            std::lock_guard<std::mutex> lock(mutex);
+            return image;
+        },
+        [&](const std::string& receivedToken, int socket) {
+            std::lock_guard<std::mutex> lock(mutex);
+            token = receivedToken;
+            tokenSocket = socket;
+            tokenReceived.notify_all();
+        });
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        image = std::make_shared<const ImageBlob>(std::vector<char>(1 << 20, 'x'), 1, FrameCompression::TarGzip);
+    }
+    TCPv6Connection listener("", "", true);
+    ASSERT_TRUE(listener.bind());
+    reactor.listen(listener.getSocket());
+    TCPv6Connection client("::1", listener.GetPort(), true);
+    client.connect();
+
+    FrameBytes headerBytes;
+    FrameHeader header;
+    ASSERT_EQ(read(client.getSocket(), headerBytes.data(), headerBytes.size()), FRAMEHEADERSIZE);
+    ASSERT_TRUE(DecodeFrameHeader(headerBytes, header));
+    ASSERT_EQ(header.type, FrameType::Hello);
+    ASSERT_EQ(header.totalSize, 1u << 20);
+    ASSERT_EQ(header.hash, image->hash());
+    client.send("TOKEN");
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        ASSERT_TRUE(tokenReceived.wait_for(lock, std::chrono::seconds(5), [&] { return tokenSocket >= 0; }));
+    }
+    ASSERT_EQ(token, "TOKEN");
+
+    reactor.enqueue(tokenSocket, image);
+    reactor.enqueue(tokenSocket, image);
+    for (int frame = 0; frame < 2; ++frame)
+    {
+        ASSERT_TRUE(ReadAll(client.getSocket(), headerBytes.data(), headerBytes.size()));
+        ASSERT_TRUE(DecodeFrameHeader(headerBytes, header));
+        ASSERT_EQ(header.type, FrameType::Image);
+        ASSERT_EQ(header.compression, FrameCompression::TarGzip);
+        ASSERT_EQ(header.imageId, 1u);
+        ASSERT_EQ(header.length, image->size());
+
+        std::vector<char> payload(header.length);
+        ASSERT_TRUE(ReadAll(client.getSocket(), payload.data(), payload.size()));
+        ASSERT_EQ(ContentHash(payload.data(), payload.size()), header.hash);
+    }
+
+    // A resumed download only carries the missing part of the image
+    reactor.enqueue(tokenSocket, image, 1000);
+    ASSERT_TRUE(ReadAll(client.getSocket(), headerBytes.data(), headerBytes.size()));
+    ASSERT_TRUE(DecodeFrameHeader(headerBytes, header));
+    ASSERT_EQ(header.offset, 1000u);
+    ASSERT_EQ(header.length, image->size() - 1000);
+    std::vector<char> rest(header.length);
+    ASSERT_TRUE(ReadAll(client.getSocket(), rest.data(), rest.size()));
+    ASSERT_EQ(ContentHash(rest.data(), rest.size(), ContentHash(image->data(), 1000)), header.hash);
+}
+
+TEST(ImageReactorTest, QueuesRequestsAndReportsClosedChannels)
+{
+    std::mutex mutex;
+    std::condition_variable changed;
+    int tokenSocket = -1;
+    int closedSocket = -1;
+    std::shared_ptr<const ImageBlob> image =
+        std::make_shared<const ImageBlob>(std::vector<char>(1 << 20, 'y'), 3, FrameCompression::EdgeMap);
+
+    ImageReactor reactor([&] { return image; },
+                         [&](const std::string&, int socket) {
+                             std::lock_guard<std::mutex> lock(mutex);
+                             tokenSocket = socket;
+                             changed.notify_all();
+                         },
+                         [&](int socket) {
+                             std::lock_guard<std::mutex> lock(mutex);
+                             closedSocket = socket;
+                             changed.notify_all();
+                         });
+    TCPv6Connection listener("", "", true);
+    ASSERT_TRUE(listener.bind());
+    reactor.listen(listener.getSocket());
+    TCPv6Connection client("::1", listener.GetPort(), true);
+    client.connect();
+
+    FrameBytes headerBytes;
+    FrameHeader header;
+    ASSERT_TRUE(ReadAll(client.getSocket(), headerBytes.data(), headerBytes.size()));
+    client.send("TOKEN");
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        ASSERT_TRUE(changed.wait_for(lock, std::chrono::seconds(5), [&] { return tokenSocket >= 0; }));
+    }
+
+    // Requests made during a transfer are all served in order, each from its own offset
+    const std::vector<std::uint64_t> offsets = {0, 1000, 2000};
+    for (std::uint64_t offset : offsets)
+    {
+        reactor.enqueue(tokenSocket, image, offset);
+    }
+    for (std::uint64_t offset : offsets)
+    {
+        ASSERT_TRUE(ReadAll(client.getSocket(), headerBytes.data(), headerBytes.size()));
+        ASSERT_TRUE(DecodeFrameHeader(headerBytes, header));
+        ASSERT_EQ(header.offset, offset);
+        ASSERT_EQ(header.length, image->size() - offset);
+        std::vector<char> payload(header.length);
+        ASSERT_TRUE(ReadAll(client.getSocket(), payload.data(), payload.size()));
+    }
+
+    shutdown(client.getSocket(), SHUT_RDWR);
+    std::unique_lock<std::mutex> lock(mutex);
+    ASSERT_TRUE(changed.wait_for(lock, std::chrono::seconds(5), [&] { return closedSocket >= 0; }));
+    ASSERT_EQ(closedSocket, tokenSocket);
+}
+
+TEST(ImageReactorTest, SendsTheSameBytesFromTheInMemoryFileAndFromMemory)
+{
+    std::vector<char> data(1 << 20);
+    for (std::size_t i = 0; i < data.size(); ++i)
+    {
+        data[i] = static_cast<char>(i % 251);
+    }
+    auto mapped = std::make_shared<const ImageBlob>(std::vector<char>(data), 4, FrameCompression::EdgeMap);
+    auto plain = std::make_shared<const ImageBlob>(std::vector<char>(data), 5, FrameCompression::EdgeMap, false);
+    if (mapped->fd() < 0)
+    {
+        GTEST_SKIP() << "In-memory files are not available";
+    }
+    ASSERT_LT(plain->fd(), 0);
+    std::vector<char> stored(data.size());
+    ASSERT_EQ(pread(mapped->fd(), stored.data(), stored.size(), 0), static_cast<ssize_t>(stored.size()));
+    ASSERT_EQ(stored, data);
+
+    std::mutex mutex;
+    std::condition_variable tokenReceived;
+    int tokenSocket = -1;
+    ImageReactor reactor([&] { return mapped; },
+                         [&](const std::string&, int socket) {
+                             std::lock_guard<std::mutex> lock(mutex);
+                             tokenSocket = socket;
+                             tokenReceived.notify_all();
+                         });
+    TCPv6Connection listener("", "", true);
+    ASSERT_TRUE(listener.bind());
+    reactor.listen(listener.getSocket());
+    TCPv6Connection client("::1", listener.GetPort(), true);
+    client.connect();
+
+    FrameBytes headerBytes;
+    FrameHeader header;
+    ASSERT_TRUE(ReadAll(client.getSocket(), headerBytes.data(), headerBytes.size()));
+    client.send("TOKEN");
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        ASSERT_TRUE(tokenReceived.wait_for(lock, std::chrono::seconds(5), [&] { return tokenSocket >= 0; }));
+    }
+
+    // The first image goes out with sendfile, the second one with send
+    const std::uint64_t offset = 1234;
+    reactor.enqueue(tokenSocket, mapped, offset);
+    reactor.enqueue(tokenSocket, plain, offset);
+    for (const auto& image : {mapped, plain})
+    {
+        ASSERT_TRUE(ReadAll(client.getSocket(), headerBytes.data(), headerBytes.size()));
+        ASSERT_TRUE(DecodeFrameHeader(headerBytes, header));
+        ASSERT_EQ(header.imageId, image->version());
+        ASSERT_EQ(header.offset, offset);
+        std::vector<char> payload(header.length);
+        ASSERT_TRUE(ReadAll(client.getSocket(), payload.data(), payload.size()));
+        ASSERT_TRUE(std::equal(payload.begin(), payload.end(), data.begin() + offset, data.end()));
+    }
+}
+
 int main(int argc, char *argv[])
 {
     ::testing::InitGoogleTest(&argc, argv);